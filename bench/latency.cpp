@@ -0,0 +1,125 @@
+// Latency of the string APIs on short inputs: p50 / p99 nanoseconds per
+// call for every length from 0 to 64 bytes.
+//
+//   c++ -std=c++17 -O2 -I.. latency.cpp -o latency
+//   ./latency [locale]
+//
+// Each sample times a batch of calls over different tokens of one length
+// and divides by the batch size, so clock overhead does not swamp calls
+// that take a few nanoseconds.
+
+#include "safe_cctype.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::size_t max_len = 64;
+constexpr std::size_t tokens = 256;   // distinct inputs per length
+constexpr std::size_t batch = 64;     // calls per sample
+constexpr std::size_t samples = 2000;
+
+// Keeps the compiler from discarding a result.
+template <class T>
+inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile char sink;
+    sink = static_cast<char>(reinterpret_cast<std::uintptr_t>(&value));
+#endif
+}
+
+struct percentiles {
+    double p50;
+    double p99;
+};
+
+template <class Call>
+percentiles measure(Call call) {
+    std::vector<double> ns(samples);
+    std::size_t next = 0;
+    for (double& sample : ns) {
+        const auto start = clock_type::now();
+        for (std::size_t i = 0; i < batch; ++i) call(next++ % tokens);
+        const std::chrono::duration<double, std::nano> took = clock_type::now() - start;
+        sample = took.count() / batch;
+    }
+    std::sort(ns.begin(), ns.end());
+    return {ns[samples / 2], ns[samples * 99 / 100]};
+}
+
+// Mixed-case words with spaces at the edges now and then, like tokens
+// split from text.
+std::vector<std::string> make_tokens(std::size_t len, std::mt19937& rng) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+    std::vector<std::string> out(tokens, std::string(len, ' '));
+    for (std::string& s : out) {
+        for (char& c : s) c = alphabet[rng() % (sizeof alphabet - 1)];
+        if (len > 2 && rng() % 4 == 0) s.front() = s.back() = ' ';
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    namespace cs = ctz::safe;
+    if (argc > 1 && cs::set_locale(LC_ALL, argv[1]) == nullptr) {
+        std::fprintf(stderr, "locale %s is not installed\n", argv[1]);
+        return 1;
+    }
+    std::printf("# kernel %s, locale %s\n", std::string(cs::kernel_name(cs::active_kernel())).c_str(),
+                std::setlocale(LC_CTYPE, nullptr));
+    std::printf("%-24s %4s %8s %8s\n", "op", "len", "p50_ns", "p99_ns");
+
+    std::mt19937 rng(42);
+    for (std::size_t len = 0; len <= max_len; ++len) {
+        const std::vector<std::string> in = make_tokens(len, rng);
+        std::vector<std::string> other = in;
+        for (std::string& s : other) cs::to_lower_inplace(s);
+        std::vector<std::string> work = in;
+
+        const auto report = [len](const char* op, percentiles p) {
+            std::printf("%-24s %4zu %8.2f %8.2f\n", op, len, p.p50, p.p99);
+        };
+        report("std::transform(ToUpper)", measure([&](std::size_t i) {
+            std::transform(work[i].begin(), work[i].end(), work[i].begin(), cs::ToUpper{});
+            keep(work[i]);
+        }));
+        report("to_upper_inplace", measure([&](std::size_t i) {
+            cs::to_upper_inplace(work[i]);
+            keep(work[i]);
+        }));
+        report("to_lower_copy", measure([&](std::size_t i) {
+            keep(cs::to_lower_copy(in[i]));
+        }));
+        report("iequals", measure([&](std::size_t i) {
+            keep(cs::iequals(in[i], other[i]));
+        }));
+        report("ihash", measure([&](std::size_t i) {
+            keep(cs::ihash(in[i]));
+        }));
+        report("std::hash(to_lower_copy)", measure([&](std::size_t i) {
+            keep(std::hash<std::string>{}(cs::to_lower_copy(in[i])));
+        }));
+        report("find_first_of_class", measure([&](std::size_t i) {
+            keep(cs::find_first_of_class(in[i], cs::char_class::digit));
+        }));
+        report("is_ascii", measure([&](std::size_t i) {
+            keep(cs::is_ascii(in[i]));
+        }));
+        report("trim", measure([&](std::size_t i) {
+            keep(cs::trim(in[i]));
+        }));
+    }
+}
@@ -0,0 +1,442 @@
+// Throughput of every bulk and per-char code path, across input corpora,
+// sizes and locales. Prints a table and, with --json, a machine-readable
+// report to diff between versions.
+//
+//   c++ -std=c++17 -O2 -I.. throughput.cpp -o throughput
+//   (-std=c++20 adds the views rows)
+//   ./throughput [--max-size BYTES] [--min-time SECONDS] [--locale NAME]...
+//                [--filter SUBSTRING] [--json FILE|-]
+//
+// Sizes run from 8 B up to --max-size (default 64 MiB; pass 1073741824 for
+// the 1 GiB runs, which need about 3 GiB of memory). Without --locale the
+// "C" locale and the first installed UTF-8 locale are measured. Locales are
+// set with std::setlocale only, so the library follows <cctype> as an
+// application that never calls set_locale would see it.
+//
+// cycles_per_byte counts time-stamp-counter ticks on x86 (the reference
+// clock, not the boosted core clock) and is null elsewhere. In-place
+// operations run repeatedly over the same buffer, so after the first pass
+// they see already converted data; none of the kernels is data dependent
+// for ASCII input.
+
+#include "safe_cctype.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <x86intrin.h>
+#  endif
+#  define CTZ_BENCH_TSC 1
+#endif
+
+namespace {
+
+namespace cs = ctz::safe;
+using clock_type = std::chrono::steady_clock;
+
+// ------------------------------
+// Options
+// ------------------------------
+struct options {
+    std::size_t max_size = std::size_t{64} << 20;
+    double min_time = 0.05;
+    std::vector<std::string> locales;
+    std::string filter;
+    std::string json;
+};
+
+bool parse_options(int argc, char** argv, options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", argv[i]);
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--max-size") opt.max_size = std::strtoull(value, nullptr, 10);
+        else if (arg == "--min-time") opt.min_time = std::strtod(value, nullptr);
+        else if (arg == "--locale") opt.locales.emplace_back(value);
+        else if (arg == "--filter") opt.filter = value;
+        else if (arg == "--json") opt.json = value;
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+    if (opt.locales.empty()) {
+        opt.locales.emplace_back("C");
+        for (const char* utf8 : {"C.UTF-8", "C.utf8", "en_US.UTF-8", "en_US.utf8"}) {
+            if (std::setlocale(LC_ALL, utf8) != nullptr) {
+                opt.locales.emplace_back(utf8);
+                break;
+            }
+        }
+        std::setlocale(LC_ALL, "C");
+    }
+    return true;
+}
+
+// ------------------------------
+// Corpora
+// ------------------------------
+struct xorshift {
+    std::uint64_t state;
+    std::uint64_t operator()() noexcept {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+// Word-shaped text drawn from letters; every 'accent' draw inserts a
+// non-ASCII sequence instead.
+std::string make_text(std::size_t n, std::string_view letters,
+                      const std::vector<std::string_view>& accents, unsigned accent_per_mille,
+                      std::uint64_t seed) {
+    xorshift rng{seed};
+    std::string out;
+    out.reserve(n + 4);
+    while (out.size() < n) {
+        const std::uint64_t r = rng();
+        if (r % 7 == 0) out += ' ';
+        else if (!accents.empty() && (r >> 8) % 1000 < accent_per_mille)
+            out += accents[(r >> 20) % accents.size()];
+        else out += letters[(r >> 32) % letters.size()];
+    }
+    out.resize(n);
+    return out;
+}
+
+struct corpus {
+    const char* name;
+    std::string data;
+};
+
+std::vector<corpus> make_corpora(std::size_t n) {
+    const std::vector<std::string_view> latin1 = {"\xe9", "\xfc", "\xc4", "\xdf", "\xf1"};
+    const std::vector<std::string_view> utf8 = {"\xc3\xa9", "\xc3\xbc", "\xc3\x84", "\xc3\x9f",
+                                                "\xe2\x82\xac"};
+    std::vector<corpus> out;
+    out.push_back({"ascii", make_text(n, "etaoinshrdlucmfwypvbgkjqxz", {}, 0, 1)});
+    out.push_back({"mixed", make_text(n, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.,;:!?-_",
+                                      {}, 0, 2)});
+    out.push_back({"latin1", make_text(n, "etaoinshrdluETAOINSHRDLU", latin1, 150, 3)});
+    out.push_back({"utf8", make_text(n, "etaoinshrdluETAOINSHRDLU", utf8, 150, 4)});
+    std::string random(n, '\0');
+    xorshift rng{5};
+    for (std::size_t i = 0; i < n; i += 8) {
+        const std::uint64_t r = rng();
+        std::memcpy(&random[i], &r, std::min<std::size_t>(8, n - i));
+    }
+    out.push_back({"random", std::move(random)});
+    return out;
+}
+
+// struct iovec's members; const, since only the read-only overloads run.
+struct segment {
+    const void* iov_base;
+    std::size_t iov_len;
+};
+
+// in cut into 1500-byte segments, as recvmsg fills them packet by packet.
+std::vector<segment> make_chain(std::string_view in) {
+    std::vector<segment> chain;
+    for (std::size_t pos = 0; pos < in.size(); pos += 1500)
+        chain.push_back({in.data() + pos, std::min<std::size_t>(1500, in.size() - pos)});
+    return chain;
+}
+
+// in cut into rows of 1 to 32 bytes, the shape of a column of short
+// fields, for the batch and column operations.
+std::vector<std::string_view> make_rows(std::string_view in) {
+    xorshift rng{6};
+    std::vector<std::string_view> rows;
+    for (std::size_t pos = 0, len = 0; pos < in.size(); pos += len) {
+        len = std::min<std::size_t>(in.size() - pos, 1 + rng() % 32);
+        rows.push_back(in.substr(pos, len));
+    }
+    return rows;
+}
+
+// ------------------------------
+// Operations
+// ------------------------------
+// Keeps results observable so the compiler cannot drop the work.
+volatile std::uint64_t sink;
+
+// What one run of an operation sees.
+struct context {
+    std::string_view in;              // the corpus
+    std::string& work;                // starts as a copy of in; in-place ops modify it
+    std::string& out;                 // result of copying ops
+    std::string_view folded;          // to_lower_copy of in, for the comparisons
+    const cs::locale_snapshot& loc;   // snapshot of the locale being measured
+    const std::vector<std::string_view>& rows;  // in as short rows, back to back
+    cs::large_string_column column;             // the same rows as a column over in
+    const std::vector<segment>& chain;          // in as a scatter-gather chain
+};
+
+struct operation {
+    const char* name;
+    void (*run)(context&);
+};
+
+template <class Pred>
+std::uint64_t count_bytes(std::string_view in, Pred pred) {
+    std::uint64_t n = 0;
+    for (char c : in) n += pred(c) ? 1 : 0;
+    return n;
+}
+
+const std::vector<operation>& operations() {
+    using cc = cs::char_class;
+    static const std::vector<operation> ops = {
+        // What callers write without this header.
+        {"baseline/std::toupper_loop", [](context& c) {
+             for (char& ch : c.work) ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+         }},
+        {"baseline/std::isalpha_loop", [](context& c) {
+             sink = count_bytes(c.in, [](char ch) { return std::isalpha(static_cast<unsigned char>(ch)) != 0; });
+         }},
+        // Per-char API.
+        {"char/std::transform(ToUpper)", [](context& c) {
+             std::transform(c.work.begin(), c.work.end(), c.work.begin(), cs::ToUpper{});
+         }},
+        {"char/std::transform(ToLower)", [](context& c) {
+             std::transform(c.work.begin(), c.work.end(), c.work.begin(), cs::ToLower{});
+         }},
+        {"char/to_upper", [](context& c) {
+             for (char& ch : c.work) ch = cs::to_upper(ch);
+         }},
+        {"char/to_lower", [](context& c) {
+             for (char& ch : c.work) ch = cs::to_lower(ch);
+         }},
+        {"char/ascii_to_upper", [](context& c) {
+             for (char& ch : c.work) ch = cs::ascii_to_upper(ch);
+         }},
+        {"char/ascii_to_lower", [](context& c) {
+             for (char& ch : c.work) ch = cs::ascii_to_lower(ch);
+         }},
+        {"char/snapshot.to_upper", [](context& c) {
+             for (char& ch : c.work) ch = c.loc.to_upper(ch);
+         }},
+        {"char/is_alpha", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_alpha(ch); }); }},
+        {"char/is_digit", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_digit(ch); }); }},
+        {"char/is_alnum", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_alnum(ch); }); }},
+        {"char/is_space", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_space(ch); }); }},
+        {"char/is_punct", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_punct(ch); }); }},
+        {"char/is_cntrl", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_cntrl(ch); }); }},
+        {"char/is_print", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_print(ch); }); }},
+        {"char/is_graph", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_graph(ch); }); }},
+        {"char/is_xdigit", [](context& c) { sink = count_bytes(c.in, [](char ch) { return cs::is_xdigit(ch); }); }},
+        {"char/is_any(alpha|digit)", [](context& c) {
+             sink = count_bytes(c.in, [](char ch) { return cs::is_any(ch, cc::alpha | cc::digit); });
+         }},
+        {"char/snapshot.is(alpha)", [](context& c) {
+             const cs::locale_snapshot& loc = c.loc;
+             sink = count_bytes(c.in, [&loc](char ch) { return loc.is(ch, cc::alpha); });
+         }},
+        // Bulk API.
+        {"bulk/to_upper_inplace", [](context& c) { cs::to_upper_inplace(c.work); }},
+        {"bulk/to_lower_inplace", [](context& c) { cs::to_lower_inplace(c.work); }},
+        {"bulk/to_upper_inplace(snapshot)", [](context& c) { cs::to_upper_inplace(c.work, c.loc); }},
+        {"bulk/to_upper_inplace(iterators)", [](context& c) { cs::to_upper_inplace(c.work.begin(), c.work.end()); }},
+        {"bulk/to_upper_copy", [](context& c) { c.out = cs::to_upper_copy(c.in); }},
+        {"bulk/to_lower_copy", [](context& c) { c.out = cs::to_lower_copy(c.in); }},
+        {"bulk/to_upper_into(string)", [](context& c) {
+             c.out.clear();  // keeps the capacity from earlier runs
+             cs::to_upper_into(c.in, c.out);
+         }},
+#if defined(__cpp_lib_ranges)
+        {"bulk/ranges::copy(views::upper)", [](context& c) {
+             c.out.resize(c.in.size());
+             std::ranges::copy(c.in | cs::views::upper, c.out.begin());
+         }},
+#endif
+        {"bulk/to_upper_batch", [](context& c) {
+             static cs::string_batch batch;  // keeps its capacity between runs
+             cs::to_upper_batch(c.rows, batch);
+         }},
+        {"bulk/to_upper_column", [](context& c) {
+             c.out.resize(c.in.size());
+             cs::to_upper_column(c.column, c.out.data());
+         }},
+        {"bulk/trim_column", [](context& c) {
+             static std::string data;
+             static std::vector<std::int64_t> offsets;
+             cs::trim_column(c.column, data, offsets);
+         }},
+        {"bulk/all_of_class_column", [](context& c) {
+             static std::vector<std::uint8_t> bits;
+             bits.resize((c.column.rows + 7) / 8);
+             cs::all_of_class_column(c.column, cc::alnum, bits.data());
+             sink = bits.empty() ? 0 : bits[0];
+         }},
+        {"bulk/is_ascii", [](context& c) { sink = cs::is_ascii(c.in); }},
+        {"bulk/find_first_not_of_class", [](context& c) { sink = cs::find_first_not_of_class(c.in, cc::cntrl); }},
+        {"bulk/find_last_not_of_class", [](context& c) { sink = cs::find_last_not_of_class(c.in, cc::cntrl); }},
+        {"bulk/trim", [](context& c) { sink = cs::trim(c.in, cc::cntrl).size(); }},
+        {"bulk/iequals", [](context& c) { sink = cs::iequals(c.in, c.folded); }},
+        {"bulk/icompare", [](context& c) { sink = static_cast<std::uint64_t>(cs::icompare(c.in, c.folded)); }},
+        {"bulk/ifind", [](context& c) { sink = cs::ifind(c.in, "\x01zq"); }},
+        {"bulk/ifind(long_needle)", [](context& c) {
+             sink = cs::ifind(c.in, "\x01 a needle longer than thirty-two bytes");
+         }},
+        {"bulk/ifind(iovec)", [](context& c) { sink = cs::ifind(c.chain.data(), c.chain.size(), "\x01zq"); }},
+        {"bulk/ihash", [](context& c) { sink = cs::ihash(c.in); }},
+    };
+    return ops;
+}
+
+// ------------------------------
+// Timing
+// ------------------------------
+inline std::uint64_t ticks() noexcept {
+#if defined(CTZ_BENCH_TSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct result {
+    std::string op;
+    const char* corpus;
+    std::size_t size;
+    std::string locale;
+    std::uint64_t iterations;
+    double seconds;
+    double gb_per_s;
+    double cycles_per_byte;
+};
+
+// Runs op until min_time has passed, after one untimed warm-up run.
+result measure(const operation& op, context& c, double min_time) {
+    op.run(c);
+    std::uint64_t iterations = 0;
+    const auto start = clock_type::now();
+    const std::uint64_t start_ticks = ticks();
+    std::chrono::duration<double> elapsed{};
+    do {
+        op.run(c);
+        ++iterations;
+        elapsed = clock_type::now() - start;
+    } while (elapsed.count() < min_time);
+    const double total_ticks = static_cast<double>(ticks() - start_ticks);
+    const double bytes = static_cast<double>(c.in.size()) * static_cast<double>(iterations);
+    result r;
+    r.op = op.name;
+    r.size = c.in.size();
+    r.iterations = iterations;
+    r.seconds = elapsed.count();
+    r.gb_per_s = bytes / r.seconds / 1e9;
+    r.cycles_per_byte = total_ticks / bytes;
+    return r;
+}
+
+// ------------------------------
+// Report
+// ------------------------------
+std::string json_escape(std::string_view s) {
+    std::string out;
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+void write_json(std::FILE* f, const std::vector<result>& results) {
+    std::fprintf(f, "{\n  \"kernel\": \"%s\",\n",
+                 std::string(cs::kernel_name(cs::active_kernel())).c_str());
+#if defined(__VERSION__)
+    std::fprintf(f, "  \"compiler\": \"%s\",\n", json_escape(__VERSION__).c_str());
+#endif
+    std::fprintf(f, "  \"results\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+        std::fprintf(f,
+                     "    {\"op\": \"%s\", \"corpus\": \"%s\", \"size\": %zu, \"locale\": \"%s\", "
+                     "\"iterations\": %llu, \"seconds\": %.6f, \"gb_per_s\": %.4f, ",
+                     json_escape(r.op).c_str(), r.corpus, r.size, json_escape(r.locale).c_str(),
+                     static_cast<unsigned long long>(r.iterations), r.seconds, r.gb_per_s);
+#if defined(CTZ_BENCH_TSC)
+        std::fprintf(f, "\"cycles_per_byte\": %.4f}", r.cycles_per_byte);
+#else
+        std::fprintf(f, "\"cycles_per_byte\": null}");
+#endif
+        std::fprintf(f, "%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    options opt;
+    if (!parse_options(argc, argv, opt)) return 2;
+
+    std::vector<std::size_t> sizes;
+    for (std::size_t n = 8; n <= opt.max_size && n <= (std::size_t{1} << 30); n *= 8) sizes.push_back(n);
+    if (sizes.empty()) return 0;
+    const std::vector<corpus> corpora = make_corpora(sizes.back());
+
+    std::printf("# kernel %s\n", std::string(cs::kernel_name(cs::active_kernel())).c_str());
+    std::printf("%-36s %-7s %11s %-12s %10s %10s\n", "op", "corpus", "size", "locale", "GB/s", "cyc/B");
+    std::vector<result> results;
+    for (const std::string& locale : opt.locales) {
+        if (std::setlocale(LC_ALL, locale.c_str()) == nullptr) {
+            std::fprintf(stderr, "locale %s is not installed; skipped\n", locale.c_str());
+            continue;
+        }
+        const cs::locale_snapshot loc;
+        for (const corpus& corp : corpora) {
+            for (std::size_t size : sizes) {
+                const std::string_view in(corp.data.data(), size);
+                std::string work(in);
+                std::string out;
+                const std::string folded = cs::to_lower_copy(in);
+                const std::vector<std::string_view> rows = make_rows(in);
+                std::vector<std::int64_t> offsets{0};
+                for (std::string_view row : rows) offsets.push_back(offsets.back() + static_cast<std::int64_t>(row.size()));
+                const std::vector<segment> chain = make_chain(in);
+                context c{in, work, out, folded, loc, rows, {in.data(), offsets.data(), rows.size()}, chain};
+                for (const operation& op : operations()) {
+                    if (!opt.filter.empty() && std::string_view(op.name).find(opt.filter) == std::string_view::npos)
+                        continue;
+                    work.assign(in);
+                    result r = measure(op, c, opt.min_time);
+                    r.corpus = corp.name;
+                    r.locale = locale;
+                    std::printf("%-36s %-7s %11zu %-12s %10.3f %10.3f\n", r.op.c_str(), r.corpus,
+                                r.size, r.locale.c_str(), r.gb_per_s, r.cycles_per_byte);
+                    std::fflush(stdout);
+                    results.push_back(std::move(r));
+                }
+            }
+        }
+    }
+
+    if (!opt.json.empty()) {
+        std::FILE* f = opt.json == "-" ? stdout : std::fopen(opt.json.c_str(), "w");
+        if (f == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", opt.json.c_str());
+            return 1;
+        }
+        write_json(f, results);
+        if (f != stdout) std::fclose(f);
+    }
+}
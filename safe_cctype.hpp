@@ -1,4 +1,4 @@
-##ifndef CTZ_SAFE_CCTYPE_HPP
+#ifndef CTZ_SAFE_CCTYPE_HPP
 #define CTZ_SAFE_CCTYPE_HPP
 
 // safe_cctype.hpp — UB‑free helpers for <cctype>
@@ -17,22 +17,245 @@
 
 #include <cctype>
 #include <algorithm>
+#include <atomic>
+#include <clocale>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#if __has_include(<memory_resource>)
+#  include <memory_resource>
+#endif
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#  if __has_include(<ranges>)
+#    include <ranges>
+#  endif
+#  if __has_include(<span>)
+#    include <span>
+#  endif
+#  if __has_include(<bit>)
+#    include <bit>
+#  endif
+#endif
+
+// SIMD kernels for the bulk transforms. On x86 every kernel is compiled
+// for its own instruction set and the best one the CPU supports is picked
+// at run time, so the binary does not need -mavx2 etc. Define
+// CTZ_SAFE_NO_SIMD to force the portable path.
+#if !defined(CTZ_SAFE_NO_SIMD) && \
+    (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#  if defined(__GNUC__) || defined(__clang__)
+#    define CTZ_SAFE_X86_DISPATCH 1
+#    define CTZ_SAFE_TARGET(isa) __attribute__((target(isa)))
+#  elif defined(_MSC_VER)
+#    define CTZ_SAFE_X86_DISPATCH 1
+#    define CTZ_SAFE_TARGET(isa)
+#    include <intrin.h>
+#  endif
+#endif
+#if defined(CTZ_SAFE_X86_DISPATCH)
+#  include <immintrin.h>
+#endif
 
 namespace ctz::safe {
 
+// ------------------------------
+// Locale snapshots
+// ------------------------------
+// A locale_snapshot reads the current C locale once into 256-entry tables.
+// The snapshot overloads below then cost one table load per byte and never
+// call into the C library. A snapshot does not follow later std::setlocale
+// calls; take a new one (or use refresh_locale()) when the locale changes.
+
+// One bit per classifier, as stored in the class tables. On glibc the bits
+// are the C library's own _IS* bits, so the active locale's class table can
+// be read directly.
+enum class char_class : std::uint16_t {
+    none   = 0,
+#if defined(__GLIBC__)
+    upper  = _ISupper,
+    lower  = _ISlower,
+    alpha  = _ISalpha,
+    digit  = _ISdigit,
+    xdigit = _ISxdigit,
+    space  = _ISspace,
+    print  = _ISprint,
+    graph  = _ISgraph,
+    blank  = _ISblank,
+    cntrl  = _IScntrl,
+    punct  = _ISpunct,
+    alnum  = _ISalnum,
+#else
+    upper  = 1u << 0,
+    lower  = 1u << 1,
+    alpha  = 1u << 2,
+    digit  = 1u << 3,
+    xdigit = 1u << 4,
+    space  = 1u << 5,
+    print  = 1u << 6,
+    graph  = 1u << 7,
+    blank  = 1u << 8,
+    cntrl  = 1u << 9,
+    punct  = 1u << 10,
+    alnum  = 1u << 11,
+#endif
+};
+
+[[nodiscard]] constexpr char_class operator|(char_class a, char_class b) noexcept {
+    return static_cast<char_class>(static_cast<std::uint16_t>(a) | static_cast<std::uint16_t>(b));
+}
+[[nodiscard]] constexpr char_class operator&(char_class a, char_class b) noexcept {
+    return static_cast<char_class>(static_cast<std::uint16_t>(a) & static_cast<std::uint16_t>(b));
+}
+
+namespace detail {
+// Ask <cctype> for each class in mask; one library call per class.
+inline std::uint16_t query_classes(int c, char_class mask) noexcept {
+    const auto want = static_cast<std::uint16_t>(mask);
+    std::uint16_t bits = 0;
+    const auto add = [&](char_class k, int (*pred)(int)) {
+        const auto b = static_cast<std::uint16_t>(k);
+        if ((want & b) != 0 && pred(c) != 0) bits = static_cast<std::uint16_t>(bits | b);
+    };
+    add(char_class::upper, [](int x) { return std::isupper(x); });
+    add(char_class::lower, [](int x) { return std::islower(x); });
+    add(char_class::alpha, [](int x) { return std::isalpha(x); });
+    add(char_class::digit, [](int x) { return std::isdigit(x); });
+    add(char_class::xdigit, [](int x) { return std::isxdigit(x); });
+    add(char_class::space, [](int x) { return std::isspace(x); });
+    add(char_class::print, [](int x) { return std::isprint(x); });
+    add(char_class::graph, [](int x) { return std::isgraph(x); });
+    add(char_class::blank, [](int x) { return std::isblank(x); });
+    add(char_class::cntrl, [](int x) { return std::iscntrl(x); });
+    add(char_class::punct, [](int x) { return std::ispunct(x); });
+    add(char_class::alnum, [](int x) { return std::isalnum(x); });
+    return bits;
+}
+
+inline constexpr char_class all_classes =
+    char_class::upper | char_class::lower | char_class::alpha | char_class::digit |
+    char_class::xdigit | char_class::space | char_class::print | char_class::graph |
+    char_class::blank | char_class::cntrl | char_class::punct | char_class::alnum;
+} // namespace detail
+
+// How a locale's case mapping relates to ascii_to_upper / ascii_to_lower.
+// The SIMD paths use this to decide how much of the work they may do.
+enum class ascii_fit : unsigned char {
+    none,      // some byte below 0x80 maps differently (e.g. Turkish 'i')
+    low_half,  // bytes below 0x80 map like ASCII, some byte above does not
+    all,       // every byte maps like ASCII
+};
+
+namespace detail {
+// upper(c) / lower(c) return the mapping of byte c as an int.
+template <class Upper, class Lower>
+inline ascii_fit measure_ascii_fit(Upper upper, Lower lower) noexcept {
+    ascii_fit fit = ascii_fit::all;
+    for (int c = 0; c < 256; ++c) {
+        const int ascii_upper = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+        const int ascii_lower = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        if (upper(c) != ascii_upper || lower(c) != ascii_lower) {
+            if (c < 0x80) return ascii_fit::none;
+            fit = ascii_fit::low_half;
+        }
+    }
+    return fit;
+}
+} // namespace detail
+
+class locale_snapshot {
+public:
+    // Captures the locale installed when the constructor runs. Reads
+    // <cctype> directly, never the published tables.
+    locale_snapshot() noexcept {
+        for (int c = 0; c < 256; ++c) {
+            classes_[c] = detail::query_classes(c, detail::all_classes);
+            upper_[c] = static_cast<unsigned char>(std::toupper(c));
+            lower_[c] = static_cast<unsigned char>(std::tolower(c));
+        }
+        fit_ = detail::measure_ascii_fit([this](int c) { return int{upper_[c]}; },
+                                         [this](int c) { return int{lower_[c]}; });
+    }
+
+    [[nodiscard]] char to_upper(char ch) const noexcept {
+        return static_cast<char>(upper_[static_cast<unsigned char>(ch)]);
+    }
+    [[nodiscard]] char to_lower(char ch) const noexcept {
+        return static_cast<char>(lower_[static_cast<unsigned char>(ch)]);
+    }
+
+    // Bitwise OR of the char_class bits that hold for ch.
+    [[nodiscard]] std::uint16_t classes(char ch) const noexcept {
+        return classes_[static_cast<unsigned char>(ch)];
+    }
+    [[nodiscard]] bool is(char ch, char_class c) const noexcept {
+        return (classes(ch) & static_cast<std::uint16_t>(c)) != 0;
+    }
+
+    // The whole class table: 256 entries, 64-byte aligned.
+    [[nodiscard]] const std::uint16_t* class_table() const noexcept { return classes_; }
+
+    [[nodiscard]] ascii_fit case_fit() const noexcept { return fit_; }
+
+    // True when the case mapping equals ascii_to_upper / ascii_to_lower for
+    // every byte, which lets the bulk overloads use the SIMD kernels.
+    [[nodiscard]] bool ascii_case() const noexcept { return fit_ == ascii_fit::all; }
+
+    [[nodiscard]] bool operator==(const locale_snapshot& o) const noexcept {
+        return std::equal(upper_, upper_ + 256, o.upper_) &&
+               std::equal(lower_, lower_ + 256, o.lower_) &&
+               std::equal(classes_, classes_ + 256, o.classes_);
+    }
+    [[nodiscard]] bool operator!=(const locale_snapshot& o) const noexcept { return !(*this == o); }
+
+private:
+    alignas(64) std::uint16_t classes_[256];
+    unsigned char upper_[256];
+    unsigned char lower_[256];
+    ascii_fit fit_ = ascii_fit::all;
+};
+
+namespace detail {
+// Tables published by refresh_locale(); null until its first call. Readers
+// only ever do an acquire load of this pointer.
+inline std::atomic<const locale_snapshot*> published_snapshot{nullptr};
+
+[[nodiscard]] inline const locale_snapshot* published_locale() noexcept {
+    return published_snapshot.load(std::memory_order_acquire);
+}
+} // namespace detail
+
 // ------------------------------
 // Character transforms (single)
 // ------------------------------
-[[nodiscard]] inline char to_upper(char ch) noexcept {
+// Once refresh_locale() has published tables, the wrappers below read
+// those instead of calling into the C library.
+namespace detail {
+// The C library's mapping, ignoring published tables.
+[[nodiscard]] inline char ctype_to_upper(char ch) noexcept {
     return static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
 }
+[[nodiscard]] inline char ctype_to_lower(char ch) noexcept {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+}
+} // namespace detail
+
+[[nodiscard]] inline char to_upper(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->to_upper(ch);
+    return detail::ctype_to_upper(ch);
+}
 
 [[nodiscard]] inline char to_lower(char ch) noexcept {
-    return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    if (const auto* loc = detail::published_locale()) return loc->to_lower(ch);
+    return detail::ctype_to_lower(ch);
 }
 
 // ------------------------------
@@ -40,94 +263,79 @@ namespace ctz::safe {
 // Return type is bool-like (int in <cctype>), but we expose bool.
 // ------------------------------
 [[nodiscard]] inline bool is_alpha(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::alpha);
     return std::isalpha(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_digit(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::digit);
     return std::isdigit(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_alnum(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::alnum);
     return std::isalnum(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_space(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::space);
     return std::isspace(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_cntrl(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::cntrl);
     return std::iscntrl(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_punct(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::punct);
     return std::ispunct(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_print(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::print);
     return std::isprint(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_graph(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::graph);
     return std::isgraph(static_cast<unsigned char>(ch)) != 0;
 }
 [[nodiscard]] inline bool is_xdigit(char ch) noexcept {
+    if (const auto* loc = detail::published_locale()) return loc->is(ch, char_class::xdigit);
     return std::isxdigit(static_cast<unsigned char>(ch)) != 0;
 }
 
 // ------------------------------
-// In-place transforms over ranges/containers
+// Compound classification
 // ------------------------------
-// Overload for std::string
-inline void to_upper_inplace(std::string& s) {
-    std::transform(s.begin(), s.end(), s.begin(),
-                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
-}
-inline void to_lower_inplace(std::string& s) {
-    std::transform(s.begin(), s.end(), s.begin(),
-                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+// One table load and one AND answer any combination of classes, e.g.
+// is_any(ch, char_class::alpha | char_class::digit | char_class::punct).
+// Reads the published tables, else the C library's own class table on
+// glibc; other platforms ask <cctype> once per class in the mask.
+namespace detail {
+// The C library's classes of ch, ignoring published tables.
+[[nodiscard]] inline std::uint16_t ctype_class_bits(char ch, char_class mask) noexcept {
+#if defined(__GLIBC__)
+    (void)mask;
+    return (*__ctype_b_loc())[static_cast<unsigned char>(ch)];
+#else
+    return query_classes(static_cast<unsigned char>(ch), mask);
+#endif
 }
-
-// Generic iterator pair (works with vector<char>, string, etc.)
-template <class It>
-inline void to_upper_inplace(It first, It last) {
-    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
-    static_assert(std::is_same_v<Char, char>,
-                  "to_upper_inplace(It,It) expects iterators over char");
-    std::transform(first, last, first,
-                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+[[nodiscard]] inline bool ctype_is_any(char ch, char_class mask) noexcept {
+    return (ctype_class_bits(ch, mask) & static_cast<std::uint16_t>(mask)) != 0;
 }
 
-template <class It>
-inline void to_lower_inplace(It first, It last) {
-    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
-    static_assert(std::is_same_v<Char, char>,
-                  "to_lower_inplace(It,It) expects iterators over char");
-    std::transform(first, last, first,
-                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+[[nodiscard]] inline std::uint16_t class_bits(char ch, char_class mask) noexcept {
+    if (const auto* loc = published_locale()) return loc->classes(ch);
+    return ctype_class_bits(ch, mask);
 }
+} // namespace detail
 
-// Copying transforms (return a new string)
-[[nodiscard]] inline std::string to_upper_copy(std::string_view sv) {
-    std::string out(sv);
-    to_upper_inplace(out);
-    return out;
+// True if ch belongs to at least one class in mask.
+[[nodiscard]] inline bool is_any(char ch, char_class mask) noexcept {
+    return (detail::class_bits(ch, mask) & static_cast<std::uint16_t>(mask)) != 0;
 }
-[[nodiscard]] inline std::string to_lower_copy(std::string_view sv) {
-    std::string out(sv);
-    to_lower_inplace(out);
-    return out;
+// True if ch belongs to every class in mask.
+[[nodiscard]] inline bool is_all(char ch, char_class mask) noexcept {
+    const auto m = static_cast<std::uint16_t>(mask);
+    return (detail::class_bits(ch, mask) & m) == m;
 }
 
-// ---------------------------------
-// Algorithm-friendly functor objects
-// ---------------------------------
-struct ToUpper {
-    [[nodiscard]] char operator()(unsigned char c) const noexcept {
-        return static_cast<char>(std::toupper(c));
-    }
-};
-struct ToLower {
-    [[nodiscard]] char operator()(unsigned char c) const noexcept {
-        return static_cast<char>(std::tolower(c));
-    }
-};
-
-// Example:
-// std::transform(s.begin(), s.end(), s.begin(), ctz::safe::ToUpper{});
-
 // ---------------------------------
 // ASCII-only fast path (optional)
 // ---------------------------------
@@ -140,6 +348,3075 @@ struct ToLower {
     return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
 }
 
+// The "C" locale classifiers, constexpr. Each is a few unsigned range
+// compares joined with | rather than ||, so there are no branches and
+// loops over them auto-vectorize. Bytes >= 0x80 belong to no class.
+namespace detail {
+constexpr unsigned ascii_byte(char ch) noexcept { return static_cast<unsigned char>(ch); }
+} // namespace detail
+
+[[nodiscard]] constexpr bool ascii_is_upper(char ch) noexcept {
+    return detail::ascii_byte(ch) - 'A' < 26u;
+}
+[[nodiscard]] constexpr bool ascii_is_lower(char ch) noexcept {
+    return detail::ascii_byte(ch) - 'a' < 26u;
+}
+[[nodiscard]] constexpr bool ascii_is_alpha(char ch) noexcept {
+    return (detail::ascii_byte(ch) | 0x20u) - 'a' < 26u;
+}
+[[nodiscard]] constexpr bool ascii_is_digit(char ch) noexcept {
+    return detail::ascii_byte(ch) - '0' < 10u;
+}
+[[nodiscard]] constexpr bool ascii_is_alnum(char ch) noexcept {
+    return ascii_is_alpha(ch) | ascii_is_digit(ch);
+}
+[[nodiscard]] constexpr bool ascii_is_xdigit(char ch) noexcept {
+    return ascii_is_digit(ch) | ((detail::ascii_byte(ch) | 0x20u) - 'a' < 6u);
+}
+[[nodiscard]] constexpr bool ascii_is_space(char ch) noexcept {
+    return (detail::ascii_byte(ch) == ' ') | (detail::ascii_byte(ch) - '\t' < 5u);  // \t \n \v \f \r
+}
+[[nodiscard]] constexpr bool ascii_is_blank(char ch) noexcept {
+    return (detail::ascii_byte(ch) == ' ') | (detail::ascii_byte(ch) == '\t');
+}
+[[nodiscard]] constexpr bool ascii_is_cntrl(char ch) noexcept {
+    return (detail::ascii_byte(ch) < 0x20u) | (detail::ascii_byte(ch) == 0x7fu);
+}
+[[nodiscard]] constexpr bool ascii_is_print(char ch) noexcept {
+    return detail::ascii_byte(ch) - 0x20u < 0x5fu;
+}
+[[nodiscard]] constexpr bool ascii_is_graph(char ch) noexcept {
+    return detail::ascii_byte(ch) - 0x21u < 0x5eu;
+}
+[[nodiscard]] constexpr bool ascii_is_punct(char ch) noexcept {
+    return ascii_is_graph(ch) & !ascii_is_alnum(ch);
+}
+
+namespace detail {
+// The "C" locale classes as C11 7.4.1 and 5.2.1 list them, checked
+// against the classifiers above for all 256 bytes at compile time.
+constexpr bool in_list(std::string_view list, char ch) noexcept {
+    return ch != '\0' && list.find(ch) != std::string_view::npos;
+}
+constexpr bool ascii_classifiers_match_c_locale() noexcept {
+    constexpr std::string_view upper = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    constexpr std::string_view lower = "abcdefghijklmnopqrstuvwxyz";
+    constexpr std::string_view digit = "0123456789";
+    constexpr std::string_view xdigit = "0123456789abcdefABCDEF";
+    constexpr std::string_view space = " \t\n\v\f\r";
+    constexpr std::string_view punct = "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+    for (unsigned u = 0; u < 256; ++u) {
+        const char ch = static_cast<char>(u);
+        const bool is_upper = in_list(upper, ch), is_lower = in_list(lower, ch);
+        const bool is_digit = in_list(digit, ch), is_punct = in_list(punct, ch);
+        const bool is_alpha = is_upper || is_lower;
+        const bool is_graph = is_alpha || is_digit || is_punct;
+        if (ascii_is_upper(ch) != is_upper || ascii_is_lower(ch) != is_lower ||
+            ascii_is_alpha(ch) != is_alpha || ascii_is_digit(ch) != is_digit ||
+            ascii_is_alnum(ch) != (is_alpha || is_digit) ||
+            ascii_is_xdigit(ch) != in_list(xdigit, ch) ||
+            ascii_is_space(ch) != in_list(space, ch) ||
+            ascii_is_blank(ch) != (ch == ' ' || ch == '\t') ||
+            ascii_is_cntrl(ch) != (u < 0x20 || u == 0x7f) ||
+            ascii_is_punct(ch) != is_punct || ascii_is_graph(ch) != is_graph ||
+            ascii_is_print(ch) != (is_graph || ch == ' '))
+            return false;
+    }
+    return true;
+}
+static_assert(ascii_classifiers_match_c_locale(),
+              "ascii_is_* must match the \"C\" locale for every byte");
+static_assert(ascii_is_space('\v') && !ascii_is_space('\x1c') && !ascii_is_alpha('\xe4') &&
+              ascii_is_punct('`') && !ascii_is_print('\x7f') && ascii_is_xdigit('F'));
+} // namespace detail
+
+// ------------------------------
+// Locale snapshot overloads
+// ------------------------------
+[[nodiscard]] inline char to_upper(char ch, const locale_snapshot& loc) noexcept {
+    return loc.to_upper(ch);
+}
+[[nodiscard]] inline char to_lower(char ch, const locale_snapshot& loc) noexcept {
+    return loc.to_lower(ch);
+}
+
+[[nodiscard]] inline bool is_alpha(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::alpha);
+}
+[[nodiscard]] inline bool is_digit(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::digit);
+}
+[[nodiscard]] inline bool is_alnum(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::alnum);
+}
+[[nodiscard]] inline bool is_space(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::space);
+}
+[[nodiscard]] inline bool is_cntrl(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::cntrl);
+}
+[[nodiscard]] inline bool is_punct(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::punct);
+}
+[[nodiscard]] inline bool is_print(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::print);
+}
+[[nodiscard]] inline bool is_graph(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::graph);
+}
+[[nodiscard]] inline bool is_xdigit(char ch, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, char_class::xdigit);
+}
+[[nodiscard]] inline bool is_any(char ch, char_class mask, const locale_snapshot& loc) noexcept {
+    return loc.is(ch, mask);
+}
+[[nodiscard]] inline bool is_all(char ch, char_class mask, const locale_snapshot& loc) noexcept {
+    const auto m = static_cast<std::uint16_t>(mask);
+    return (loc.classes(ch) & m) == m;
+}
+
+// 256-bit membership set for a class mask: 32 bytes instead of the 512-byte
+// class table, for callers who care about L1 footprint. A byte is a member
+// if it belongs to any class in the mask. The bits are stored nibble-
+// transposed so the same 32 bytes drive the SIMD class scanners: byte u
+// lives in lanes()[(u >> 7) * 16 + (u & 15)], bit (u >> 4) & 7.
+class class_set {
+public:
+    constexpr class_set() noexcept = default;
+    // Built from the published tables, else the current locale.
+    explicit class_set(char_class mask) noexcept {
+        if (const auto* loc = detail::published_locale()) {
+            *this = class_set(mask, *loc);
+            return;
+        }
+        for (int c = 0; c < 256; ++c)
+            if (detail::ctype_is_any(static_cast<char>(c), mask)) insert(static_cast<char>(c));
+    }
+    class_set(char_class mask, const locale_snapshot& loc) noexcept {
+        for (int c = 0; c < 256; ++c)
+            if (loc.is(static_cast<char>(c), mask)) insert(static_cast<char>(c));
+    }
+
+    [[nodiscard]] constexpr bool contains(char ch) const noexcept {
+        const auto u = static_cast<unsigned char>(ch);
+        return ((lanes_[lane(u)] >> ((u >> 4) & 7)) & 1u) != 0;
+    }
+    constexpr void insert(char ch) noexcept {
+        const auto u = static_cast<unsigned char>(ch);
+        lanes_[lane(u)] = static_cast<std::uint8_t>(lanes_[lane(u)] | (1u << ((u >> 4) & 7)));
+    }
+
+    [[nodiscard]] constexpr const std::uint8_t* lanes() const noexcept { return lanes_; }
+
+private:
+    static constexpr unsigned lane(unsigned u) noexcept { return ((u >> 7) << 4) | (u & 15); }
+
+    alignas(32) std::uint8_t lanes_[32] = {};
+};
+
+// ------------------------------
+// Published locale tables
+// ------------------------------
+// refresh_locale() snapshots the current locale and publishes it with a
+// release store; every wrapper without a snapshot argument then reads it
+// with a single acquire load, so there is no lock on the per-byte path.
+// Published snapshots are never freed (readers may still hold them) but
+// are interned, so flipping between locales reuses the existing tables and
+// memory stays bounded by the number of distinct locales seen.
+// A string routine loads the pointer once per call, so its result follows
+// one locale throughout even while another thread republishes.
+//
+// Call refresh_locale() after every std::setlocale that touches LC_CTYPE,
+// or use set_locale(), which does both.
+namespace detail {
+struct snapshot_registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<const locale_snapshot>> snapshots;
+};
+
+inline snapshot_registry& published_snapshots() {
+    static snapshot_registry registry;
+    return registry;
+}
+
+// Snapshot of the current locale, interned: the result is never freed.
+inline const locale_snapshot* intern_locale() {
+    auto fresh = std::make_unique<const locale_snapshot>();
+    auto& registry = published_snapshots();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& known : registry.snapshots)
+        if (*known == *fresh) return known.get();
+    registry.snapshots.push_back(std::move(fresh));
+    return registry.snapshots.back().get();
+}
+} // namespace detail
+
+inline const locale_snapshot& refresh_locale() {
+    const locale_snapshot* chosen = detail::intern_locale();
+    detail::published_snapshot.store(chosen, std::memory_order_release);
+    return *chosen;
+}
+
+// std::setlocale followed by refresh_locale() when LC_CTYPE may have changed.
+inline const char* set_locale(int category, const char* locale) {
+    const char* result = std::setlocale(category, locale);
+    if (result != nullptr && locale != nullptr && (category == LC_ALL || category == LC_CTYPE))
+        refresh_locale();
+    return result;
+}
+
+// ---------------------------------
+// Bulk kernels (implementation detail)
+// ---------------------------------
+// The kernels below apply ascii_to_upper / ascii_to_lower to a whole
+// buffer. They are only used when the active locale's case mapping is
+// byte-for-byte identical to the ASCII one (true for "C", "POSIX" and the
+// UTF-8 locales), so the result always equals the per-byte std::toupper /
+// std::tolower path.
+
+// Instruction sets the bulk kernels are built for, in preference order.
+enum class kernel_isa : unsigned char { scalar, sse2, avx2, avx512bw };
+
+[[nodiscard]] constexpr std::string_view kernel_name(kernel_isa isa) noexcept {
+    switch (isa) {
+    case kernel_isa::sse2:     return "sse2";
+    case kernel_isa::avx2:     return "avx2";
+    case kernel_isa::avx512bw: return "avx512bw";
+    default:                   return "scalar";
+    }
+}
+
+// Bytes of one or more bulk case conversions, by the path that took them.
+struct case_stats {
+    std::size_t ascii_bytes = 0;   // SIMD ASCII kernel
+    std::size_t locale_bytes = 0;  // per-byte locale mapping
+};
+
+namespace detail {
+
+// First letter of the range a kernel flips: 'a' for upper, 'A' for lower.
+template <bool Upper>
+inline constexpr char ascii_case_first = Upper ? 'a' : 'A';
+
+// Bit scans; x must be non-zero. <bit> where available, else the GCC /
+// Clang builtins, else a de Bruijn multiply, which also covers MSVC
+// targets without the 64-bit scan intrinsics (32-bit x86, and any build
+// that does not include <intrin.h>).
+inline int debruijn_index(std::uint64_t single_bit) noexcept {
+    constexpr std::uint64_t debruijn = 0x03f79d71b4cb0a89ULL;
+    constexpr unsigned char index[64] = {
+        0,  1,  48, 2,  57, 49, 28, 3,  61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9,  13, 8,  7,  6};
+    return index[(single_bit * debruijn) >> 58];
+}
+
+inline int count_trailing_zeros(std::uint64_t x) noexcept {
+#if defined(__cpp_lib_bitops)
+    return std::countr_zero(x);
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    return debruijn_index(x & (~x + 1));
+#endif
+}
+// Index of the highest set bit.
+inline int highest_bit(std::uint64_t x) noexcept {
+#if defined(__cpp_lib_bitops)
+    return 63 - std::countl_zero(x);
+#elif defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(x);
+#else
+    for (int shift = 1; shift < 64; shift <<= 1) x |= x >> shift;
+    return debruijn_index(x - (x >> 1));
+#endif
+}
+
+// Short inputs (h <= n < 2h) are loaded as two overlapping h-byte halves:
+// bit j < h of m is byte j and bit h + j is byte n - h + j. These return
+// the first/last byte whose bit is set, or n.
+inline std::size_t first_of_halves(std::uint64_t m, std::size_t n, std::size_t h) noexcept {
+    if (const std::uint64_t lo = m & ((std::uint64_t{1} << h) - 1))
+        return static_cast<std::size_t>(count_trailing_zeros(lo));
+    const std::uint64_t hi = (m & ((std::uint64_t{1} << 2 * h) - 1)) >> (3 * h - n);
+    return hi ? h + static_cast<std::size_t>(count_trailing_zeros(hi)) : n;
+}
+inline std::size_t last_of_halves(std::uint64_t m, std::size_t n, std::size_t h) noexcept {
+    if (const std::uint64_t hi = (m >> h) & ((std::uint64_t{1} << h) - 1))
+        return n - h + static_cast<std::size_t>(highest_bit(hi));
+    const std::uint64_t lo = m & ((std::uint64_t{1} << (n - h)) - 1);
+    return lo ? static_cast<std::size_t>(highest_bit(lo)) : n;
+}
+
+// Portable word-at-a-time (SWAR) kernels. They work on eight bytes per
+// step with plain 64-bit arithmetic, form the dispatch baseline and also
+// finish the tails of the SIMD kernels. Byte lanes never carry into each
+// other, so the results do not depend on endianness.
+using swar_word = std::uint64_t;
+inline constexpr std::size_t swar_bytes = sizeof(swar_word);
+inline constexpr swar_word swar_ones = ~swar_word{0} / 0xff;  // 0x0101...01
+inline constexpr swar_word swar_high = swar_ones * 0x80;       // 0x8080...80
+
+inline swar_word swar_load(const char* p) noexcept {
+    swar_word w;
+    std::memcpy(&w, p, sizeof w);
+    return w;
+}
+inline void swar_store(char* p, swar_word w) noexcept { std::memcpy(p, &w, sizeof w); }
+
+// 0x80 in every lane holding an ASCII letter of the case a kernel flips.
+// With the high bit masked off, x + (0x80 - lo) reaches 0x80 exactly when
+// x >= lo, and no lane can overflow into its neighbour.
+template <bool Upper>
+inline swar_word swar_case_mask(swar_word w) noexcept {
+    constexpr unsigned lo = static_cast<unsigned char>(ascii_case_first<Upper>);
+    const swar_word x = w & ~swar_high;
+    const swar_word ge_lo = x + swar_ones * (0x80 - lo);
+    const swar_word gt_hi = x + swar_ones * (0x80 - lo - 26);
+    return (ge_lo ^ gt_hi) & ~w & swar_high;
+}
+template <bool Upper>
+inline swar_word swar_case(swar_word w) noexcept {
+    return w ^ (swar_case_mask<Upper>(w) >> 2);  // 0x80 >> 2 == 0x20
+}
+// 0x80 in every lane whose byte equals the matching byte of b (exact for
+// every lane, unlike the classic has-zero test).
+inline swar_word swar_eq(swar_word a, swar_word b) noexcept {
+    const swar_word x = a ^ b;
+    return ~(((x & ~swar_high) + ~swar_high) | x) & swar_high;
+}
+
+// Inputs up to this length skip the dispatched kernels and call the SWAR
+// ones inline: they finish before an indirect call and a SIMD prologue
+// would, and most tokens (words, keys, identifiers) are this short.
+inline constexpr std::size_t short_input_max = 32;
+
+// The case kernels read [src, src+n) and write [dst, dst+n); src may equal
+// dst for an in-place conversion, but the ranges must not otherwise
+// overlap.
+//
+// Tails are handled with a last word that overlaps the previous one rather
+// than a byte loop; converting a byte twice is harmless. The last word is
+// loaded before any store so it never waits on a partial store forward.
+template <bool Upper>
+inline void ascii_case_swar(const char* src, char* dst, std::size_t n) noexcept {
+    if (n >= swar_bytes) {
+        const swar_word last = swar_case<Upper>(swar_load(src + n - swar_bytes));
+        for (std::size_t i = 0; i + swar_bytes < n; i += swar_bytes)
+            swar_store(dst + i, swar_case<Upper>(swar_load(src + i)));
+        swar_store(dst + n - swar_bytes, last);
+    } else if (n >= 4) {
+        // Two overlapping 4-byte halves of one word.
+        std::uint32_t lo, hi;
+        std::memcpy(&lo, src, 4);
+        std::memcpy(&hi, src + n - 4, 4);
+        const swar_word w = swar_case<Upper>(lo | swar_word{hi} << 32);
+        lo = static_cast<std::uint32_t>(w);
+        hi = static_cast<std::uint32_t>(w >> 32);
+        std::memcpy(dst + n - 4, &hi, 4);
+        std::memcpy(dst, &lo, 4);
+    } else {
+        for (std::size_t i = 0; i < n; ++i)
+            dst[i] = Upper ? ascii_to_upper(src[i]) : ascii_to_lower(src[i]);
+    }
+}
+
+// Class-span scanners: index of the first/last byte whose membership in
+// set equals member, or n when there is none. Membership is a table
+// lookup per byte; the eight results of a word are combined so that only
+// a hit branches.
+inline unsigned swar_members(const char* p, const class_set& set, bool member) noexcept {
+    unsigned hits = 0;
+    for (unsigned k = 0; k < swar_bytes; ++k)
+        hits |= static_cast<unsigned>(set.contains(p[k]) == member) << k;
+    return hits;
+}
+inline std::size_t find_first_swar(const char* p, std::size_t n, const class_set& set,
+                                   bool member) noexcept {
+    std::size_t i = 0;
+    for (; i + swar_bytes <= n; i += swar_bytes)
+        if (const unsigned hits = swar_members(p + i, set, member))
+            return i + static_cast<std::size_t>(count_trailing_zeros(hits));
+    for (; i < n; ++i)
+        if (set.contains(p[i]) == member) return i;
+    return n;
+}
+inline std::size_t find_last_swar(const char* p, std::size_t n, const class_set& set,
+                                  bool member) noexcept {
+    std::size_t i = n;
+    for (; i >= swar_bytes; i -= swar_bytes)
+        if (const unsigned hits = swar_members(p + i - swar_bytes, set, member))
+            return i - swar_bytes + static_cast<std::size_t>(highest_bit(hits));
+    while (i-- > 0)
+        if (set.contains(p[i]) == member) return i;
+    return n;
+}
+
+// Index of the first (memory order) lane with 0x80 set in mask, which
+// must have one.
+inline std::size_t swar_first_lane(swar_word mask) noexcept {
+    unsigned char lanes[swar_bytes];
+    std::memcpy(lanes, &mask, sizeof mask);
+    std::size_t k = 0;
+    while (!(lanes[k] & 0x80)) ++k;
+    return k;
+}
+
+// Case-insensitive mismatch: index of the first byte where the ASCII-folded
+// inputs differ or, with stop_at_high, where either byte is >= 0x80; n if
+// there is none.
+inline std::size_t ifold_mismatch_swar(const char* a, const char* b, std::size_t n,
+                                       bool stop_at_high) noexcept {
+    const swar_word high = stop_at_high ? swar_high : 0;
+    std::size_t i = 0;
+    // The last word may overlap lanes already found clean, so its first
+    // stop is still the first in the input.
+    for (; n >= swar_bytes; i = std::min(i + swar_bytes, n - swar_bytes)) {
+        const swar_word wa = swar_load(a + i), wb = swar_load(b + i);
+        const swar_word stop =
+            (~swar_eq(swar_case<false>(wa), swar_case<false>(wb)) | ((wa | wb) & high)) & swar_high;
+        if (stop) return i + swar_first_lane(stop);
+        if (i + swar_bytes == n) return n;
+    }
+    for (; i < n; ++i) {
+        if (ascii_to_lower(a[i]) != ascii_to_lower(b[i])) return i;
+        if (stop_at_high && ((static_cast<unsigned char>(a[i]) | static_cast<unsigned char>(b[i])) & 0x80))
+            return i;
+    }
+    return n;
+}
+
+// Writes ascii_to_lower of the 32 bytes at src to dst; returns non-zero if
+// any of them is >= 0x80.
+inline unsigned ascii_fold_block32_swar(const char* src, unsigned char* dst) noexcept {
+    swar_word high = 0;
+    for (std::size_t i = 0; i < 32; i += swar_bytes) {
+        const swar_word w = swar_case<false>(swar_load(src + i));
+        std::memcpy(dst + i, &w, sizeof w);
+        high |= w;
+    }
+    return (high & swar_high) != 0;
+}
+
+// ASCII-folded substring search in h[0, n) for a needle of 1 <= m <= n
+// bytes: position of the first (Reverse: last) match, or n if none. Whole
+// words of candidate positions are screened for the folded first byte.
+template <bool Reverse>
+inline std::size_t ifind_ascii_swar(const char* h, std::size_t n, const char* needle,
+                                    std::size_t m) noexcept {
+    const char first = ascii_to_lower(needle[0]);
+    const swar_word pattern = swar_ones * static_cast<unsigned char>(first);
+    const std::size_t count = n - m + 1;  // candidate positions
+    const auto matches = [&](std::size_t i) {
+        return ifold_mismatch_swar(h + i + 1, needle + 1, m - 1, false) == m - 1;
+    };
+    const std::size_t words = count / swar_bytes;
+    for (std::size_t w = 0; w < words; ++w) {
+        const std::size_t base = Reverse ? count - (w + 1) * swar_bytes : w * swar_bytes;
+        const swar_word hits = swar_eq(swar_case<false>(swar_load(h + base)), pattern);
+        if (!hits) continue;
+        unsigned char lanes[swar_bytes];
+        std::memcpy(lanes, &hits, sizeof hits);
+        for (std::size_t k = 0; k < swar_bytes; ++k) {
+            const std::size_t lane = Reverse ? swar_bytes - 1 - k : k;
+            if ((lanes[lane] & 0x80) && matches(base + lane)) return base + lane;
+        }
+    }
+    const std::size_t rest = count - words * swar_bytes;
+    for (std::size_t k = 0; k < rest; ++k) {
+        const std::size_t i = Reverse ? rest - 1 - k : words * swar_bytes + k;
+        if (ascii_to_lower(h[i]) == first && matches(i)) return i;
+    }
+    return n;
+}
+
+// Length of the leading run of bytes below 0x80.
+inline std::size_t ascii_prefix_swar(const char* p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; n >= swar_bytes; i = std::min(i + swar_bytes, n - swar_bytes)) {
+        if (const swar_word high = swar_load(p + i) & swar_high)
+            return i + swar_first_lane(high);
+        if (i + swar_bytes == n) return n;
+    }
+    for (; i < n; ++i)
+        if (static_cast<unsigned char>(p[i]) & 0x80u) return i;
+    return n;
+}
+
+#if defined(CTZ_SAFE_X86_DISPATCH)
+// SSE2 has no unsigned byte compare, so bias the range [first, first+26)
+// down onto [-128, -102) and test it with a signed compare.
+template <bool Upper>
+CTZ_SAFE_TARGET("sse2") inline __m128i ascii_case_sse2_block(__m128i v) noexcept {
+    const __m128i bias  = _mm_set1_epi8(static_cast<char>(0x80 - ascii_case_first<Upper>));
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(-128 + 26));
+    const __m128i hit   = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+    return _mm_xor_si128(v, _mm_and_si128(hit, _mm_set1_epi8(0x20)));
+}
+
+template <bool Upper>
+CTZ_SAFE_TARGET("sse2") inline void ascii_case_sse2(const char* src, char* dst,
+                                                    std::size_t n) noexcept {
+    if (n < 16) {
+        ascii_case_swar<Upper>(src, dst, n);
+        return;
+    }
+    // Overlap the last full block; the mapping is idempotent.
+    const __m128i last =
+        ascii_case_sse2_block<Upper>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n - 16)));
+    for (std::size_t i = 0; i + 16 < n; i += 16)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         ascii_case_sse2_block<Upper>(
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n - 16), last);
+}
+
+template <bool Upper>
+CTZ_SAFE_TARGET("avx2") inline __m256i ascii_case_avx2_block(__m256i v) noexcept {
+    const __m256i bias  = _mm256_set1_epi8(static_cast<char>(0x80 - ascii_case_first<Upper>));
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(-128 + 26));
+    const __m256i hit   = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+    return _mm256_xor_si256(v, _mm256_and_si256(hit, _mm256_set1_epi8(0x20)));
+}
+
+template <bool Upper>
+CTZ_SAFE_TARGET("avx2") inline void ascii_case_avx2(const char* src, char* dst,
+                                                    std::size_t n) noexcept {
+    if (n < 32) {
+        ascii_case_sse2<Upper>(src, dst, n);
+        return;
+    }
+    const __m256i last = ascii_case_avx2_block<Upper>(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n - 32)));
+    for (std::size_t i = 0; i + 32 < n; i += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            ascii_case_avx2_block<Upper>(
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + n - 32), last);
+}
+
+// AVX-512BW handles the tail with a masked load/store, which never touches
+// bytes past n. In place, only the bytes that change are stored.
+template <bool Upper>
+CTZ_SAFE_TARGET("avx512bw") inline void ascii_case_avx512bw(const char* src, char* dst,
+                                                            std::size_t n) noexcept {
+    const __m512i first = _mm512_set1_epi8(ascii_case_first<Upper>);
+    const __m512i width = _mm512_set1_epi8(26);
+    const __m512i flip  = _mm512_set1_epi8(0x20);
+    for (std::size_t i = 0; i < n; i += 64) {
+        const std::size_t rem = n - i;
+        const __mmask64 live = rem >= 64 ? ~__mmask64{0} : (__mmask64{1} << rem) - 1;
+        const __m512i v = _mm512_maskz_loadu_epi8(live, src + i);
+        const __mmask64 hit =
+            _mm512_mask_cmplt_epu8_mask(live, _mm512_sub_epi8(v, first), width);
+        if (src == dst)
+            _mm512_mask_storeu_epi8(dst + i, hit, _mm512_xor_si512(v, flip));
+        else
+            _mm512_mask_storeu_epi8(dst + i, live,
+                                    _mm512_mask_blend_epi8(hit, v, _mm512_xor_si512(v, flip)));
+    }
+}
+
+// Nibble-shuffle class lookup: the low nibble selects a lane byte (one
+// table for bytes below 0x80, one for the rest; pshufb zeroes the other),
+// the high nibble selects the bit within it.
+CTZ_SAFE_TARGET("avx2") inline std::uint32_t class_members_avx2(__m256i v, __m256i low,
+                                                                  __m256i high) noexcept {
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i row = _mm256_or_si256(
+        _mm256_shuffle_epi8(low, v),
+        _mm256_shuffle_epi8(high, _mm256_xor_si256(v, _mm256_set1_epi8(-128))));
+    const __m256i col = _mm256_shuffle_epi8(
+        bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f)));
+    const __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(row, col), _mm256_setzero_si256());
+    return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(miss));
+}
+
+// Inputs of 8 to 31 bytes as two overlapping halves of *half bytes (see
+// first_of_halves); the unused upper lane of the 8-byte form repeats the
+// lower one.
+CTZ_SAFE_TARGET("avx2") inline __m256i load_halves_avx2(const char* p, std::size_t n,
+                                                        std::size_t* half) noexcept {
+    if (n >= 16) {
+        *half = 16;
+        return _mm256_set_m128i(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 16)),
+                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+    *half = 8;
+    const __m128i v = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                                         _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + n - 8)));
+    return _mm256_set_m128i(v, v);
+}
+
+CTZ_SAFE_TARGET("avx2") inline std::size_t find_first_avx2(const char* p, std::size_t n,
+                                                            const class_set& set,
+                                                            bool member) noexcept {
+    if (n < 8) return find_first_swar(p, n, set, member);
+    const auto* lanes = reinterpret_cast<const __m128i*>(set.lanes());
+    const __m256i low  = _mm256_broadcastsi128_si256(_mm_load_si128(lanes));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(lanes + 1));
+    const std::uint32_t flip = member ? 0u : ~0u;
+    if (n < 32) {
+        std::size_t half;
+        const __m256i v = load_halves_avx2(p, n, &half);
+        return first_of_halves(class_members_avx2(v, low, high) ^ flip, n, half);
+    }
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        if (const std::uint32_t m = class_members_avx2(v, low, high) ^ flip)
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    if (i < n) {
+        // Overlap the last full block and drop the bytes already checked.
+        const std::size_t start = n - 32;
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + start));
+        if (const std::uint32_t m = (class_members_avx2(v, low, high) ^ flip) >> (i - start))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("avx2") inline std::size_t find_last_avx2(const char* p, std::size_t n,
+                                                           const class_set& set,
+                                                           bool member) noexcept {
+    if (n < 8) return find_last_swar(p, n, set, member);
+    const auto* lanes = reinterpret_cast<const __m128i*>(set.lanes());
+    const __m256i low  = _mm256_broadcastsi128_si256(_mm_load_si128(lanes));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(lanes + 1));
+    const std::uint32_t flip = member ? 0u : ~0u;
+    if (n < 32) {
+        std::size_t half;
+        const __m256i v = load_halves_avx2(p, n, &half);
+        return last_of_halves(class_members_avx2(v, low, high) ^ flip, n, half);
+    }
+    std::size_t end = n;
+    for (; end >= 32; end -= 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + end - 32));
+        if (const std::uint32_t m = class_members_avx2(v, low, high) ^ flip)
+            return end - 32 + static_cast<std::size_t>(highest_bit(m));
+    }
+    if (end > 0) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const std::uint32_t keep = (std::uint32_t{1} << end) - 1;
+        if (const std::uint32_t m = (class_members_avx2(v, low, high) ^ flip) & keep)
+            return static_cast<std::size_t>(highest_bit(m));
+    }
+    return n;
+}
+
+// The zero-masked form of _mm512_broadcast_i32x4: same instruction, but it
+// avoids GCC's -Wuninitialized false positive on the unmasked intrinsic.
+CTZ_SAFE_TARGET("avx512bw") inline __m512i broadcast_lane_avx512bw(__m128i v) noexcept {
+    return _mm512_maskz_broadcast_i32x4(0xffff, v);
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline __mmask64 class_members_avx512bw(__m512i v, __m512i low,
+                                                                     __m512i high) noexcept {
+    const __m512i bits = broadcast_lane_avx512bw(
+        _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+    const __m512i row = _mm512_or_si512(
+        _mm512_shuffle_epi8(low, v),
+        _mm512_shuffle_epi8(high, _mm512_xor_si512(v, _mm512_set1_epi8(-128))));
+    const __m512i col = _mm512_shuffle_epi8(
+        bits, _mm512_and_si512(_mm512_srli_epi16(v, 4), _mm512_set1_epi8(0x0f)));
+    return _mm512_test_epi8_mask(row, col);
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline std::size_t find_first_avx512bw(const char* p, std::size_t n,
+                                                                    const class_set& set,
+                                                                    bool member) noexcept {
+    const auto* lanes = reinterpret_cast<const __m128i*>(set.lanes());
+    const __m512i low  = broadcast_lane_avx512bw(_mm_load_si128(lanes));
+    const __m512i high = broadcast_lane_avx512bw(_mm_load_si128(lanes + 1));
+    const __mmask64 flip = member ? 0 : ~__mmask64{0};
+    for (std::size_t i = 0; i < n; i += 64) {
+        const std::size_t rem = n - i;
+        const __mmask64 live = rem >= 64 ? ~__mmask64{0} : (__mmask64{1} << rem) - 1;
+        const __m512i v = _mm512_maskz_loadu_epi8(live, p + i);
+        if (const __mmask64 m = (class_members_avx512bw(v, low, high) ^ flip) & live)
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline std::size_t find_last_avx512bw(const char* p, std::size_t n,
+                                                                   const class_set& set,
+                                                                   bool member) noexcept {
+    const auto* lanes = reinterpret_cast<const __m128i*>(set.lanes());
+    const __m512i low  = broadcast_lane_avx512bw(_mm_load_si128(lanes));
+    const __m512i high = broadcast_lane_avx512bw(_mm_load_si128(lanes + 1));
+    const __mmask64 flip = member ? 0 : ~__mmask64{0};
+    for (std::size_t end = n; end > 0;) {
+        const std::size_t start = end >= 64 ? end - 64 : 0;
+        const std::size_t len = end - start;
+        const __mmask64 live = len >= 64 ? ~__mmask64{0} : (__mmask64{1} << len) - 1;
+        const __m512i v = _mm512_maskz_loadu_epi8(live, p + start);
+        if (const __mmask64 m = (class_members_avx512bw(v, low, high) ^ flip) & live)
+            return start + static_cast<std::size_t>(highest_bit(m));
+        end = start;
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("sse2") inline unsigned ifold_misses_sse2(__m128i va, __m128i vb,
+                                                          bool stop_at_high) noexcept {
+    const __m128i eq =
+        _mm_cmpeq_epi8(ascii_case_sse2_block<false>(va), ascii_case_sse2_block<false>(vb));
+    unsigned m = ~static_cast<unsigned>(_mm_movemask_epi8(eq)) & 0xffffu;
+    if (stop_at_high) m |= static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(va, vb)));
+    return m;
+}
+CTZ_SAFE_TARGET("sse2") inline unsigned ifold_misses_sse2(const char* a, const char* b,
+                                                          bool stop_at_high) noexcept {
+    return ifold_misses_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), stop_at_high);
+}
+// Bytes 0-7 and n-8 .. n-1 of an input of 8 to 15 bytes.
+CTZ_SAFE_TARGET("sse2") inline __m128i load_halves_sse2(const char* p, std::size_t n) noexcept {
+    return _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                              _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + n - 8)));
+}
+
+CTZ_SAFE_TARGET("sse2") inline std::size_t ifold_mismatch_sse2(const char* a, const char* b,
+                                                               std::size_t n,
+                                                               bool stop_at_high) noexcept {
+    if (n < 8) return ifold_mismatch_swar(a, b, n, stop_at_high);
+    if (n < 16)
+        return first_of_halves(
+            ifold_misses_sse2(load_halves_sse2(a, n), load_halves_sse2(b, n), stop_at_high), n, 8);
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        if (const unsigned m = ifold_misses_sse2(a + i, b + i, stop_at_high))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    if (i < n) {
+        const std::size_t start = n - 16;
+        if (const unsigned m = ifold_misses_sse2(a + start, b + start, stop_at_high) >> (i - start))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("avx2") inline std::uint32_t ifold_misses_avx2(const char* a, const char* b,
+                                                               bool stop_at_high) noexcept {
+    const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    const __m256i eq =
+        _mm256_cmpeq_epi8(ascii_case_avx2_block<false>(va), ascii_case_avx2_block<false>(vb));
+    std::uint32_t m = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(eq));
+    if (stop_at_high) m |= static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(va, vb)));
+    return m;
+}
+
+CTZ_SAFE_TARGET("avx2") inline std::size_t ifold_mismatch_avx2(const char* a, const char* b,
+                                                               std::size_t n,
+                                                               bool stop_at_high) noexcept {
+    if (n < 32) return ifold_mismatch_sse2(a, b, n, stop_at_high);
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+        if (const std::uint32_t m = ifold_misses_avx2(a + i, b + i, stop_at_high))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    if (i < n) {
+        const std::size_t start = n - 32;
+        if (const std::uint32_t m = ifold_misses_avx2(a + start, b + start, stop_at_high) >> (i - start))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline __m512i ascii_lower_avx512bw(__m512i v) noexcept {
+    const __mmask64 upper =
+        _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8('A')), _mm512_set1_epi8(26));
+    return _mm512_mask_add_epi8(v, upper, v, _mm512_set1_epi8(0x20));
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline std::size_t ifold_mismatch_avx512bw(const char* a,
+                                                                       const char* b,
+                                                                       std::size_t n,
+                                                                       bool stop_at_high) noexcept {
+    for (std::size_t i = 0; i < n; i += 64) {
+        const std::size_t rem = n - i;
+        const __mmask64 live = rem >= 64 ? ~__mmask64{0} : (__mmask64{1} << rem) - 1;
+        const __m512i va = _mm512_maskz_loadu_epi8(live, a + i);
+        const __m512i vb = _mm512_maskz_loadu_epi8(live, b + i);
+        __mmask64 m = _mm512_mask_cmpneq_epi8_mask(live, ascii_lower_avx512bw(va),
+                                                   ascii_lower_avx512bw(vb));
+        if (stop_at_high) m |= _mm512_movepi8_mask(_mm512_or_si512(va, vb)) & live;
+        if (m) return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("sse2") inline unsigned ascii_fold_block32_sse2(const char* src,
+                                                                unsigned char* dst) noexcept {
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), ascii_case_sse2_block<false>(lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), ascii_case_sse2_block<false>(hi));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(lo, hi)));
+}
+
+CTZ_SAFE_TARGET("avx2") inline unsigned ascii_fold_block32_avx2(const char* src,
+                                                                unsigned char* dst) noexcept {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), ascii_case_avx2_block<false>(v));
+    return static_cast<unsigned>(_mm256_movemask_epi8(v));
+}
+
+// First/last-byte candidate filter: a start position survives only if both
+// its first and its last byte match the needle's in either case; survivors
+// are verified with the fold compare.
+struct ifind_probe_avx2 {
+    __m256i f1, f2, l1, l2;
+};
+
+// Candidate bitmask for the 32 start positions [i, i+32).
+CTZ_SAFE_TARGET("avx2") inline std::uint32_t ifind_candidates_avx2(const char* h, std::size_t i,
+                                                                   std::size_t m,
+                                                                   const ifind_probe_avx2& q) noexcept {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + m - 1));
+    const __m256i hit =
+        _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, q.f1), _mm256_cmpeq_epi8(a, q.f2)),
+                         _mm256_or_si256(_mm256_cmpeq_epi8(b, q.l1), _mm256_cmpeq_epi8(b, q.l2)));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(hit));
+}
+
+// Does the match starting at h+i hold on the bytes between first and last?
+CTZ_SAFE_TARGET("avx2") inline bool ifind_verify_avx2(const char* h, std::size_t i,
+                                                      const char* needle, std::size_t m) noexcept {
+    return m <= 2 || ifold_mismatch_avx2(h + i + 1, needle + 1, m - 2, false) == m - 2;
+}
+
+template <bool Reverse>
+CTZ_SAFE_TARGET("avx2") inline std::size_t ifind_ascii_avx2(const char* h, std::size_t n,
+                                                            const char* needle,
+                                                            std::size_t m) noexcept {
+    const std::size_t last = n - m;
+    if (last < 32) return ifind_ascii_swar<Reverse>(h, n, needle, m);
+    const char f = ascii_to_lower(needle[0]);
+    const char l = ascii_to_lower(needle[m - 1]);
+    const ifind_probe_avx2 q = {_mm256_set1_epi8(f), _mm256_set1_epi8(ascii_to_upper(f)),
+                                _mm256_set1_epi8(l), _mm256_set1_epi8(ascii_to_upper(l))};
+    if (!Reverse) {
+        // Every block covers 32 start positions, all of them <= last.
+        std::size_t i = 0;
+        for (; i + 32 <= last + 1; i += 32) {
+            for (std::uint32_t mask = ifind_candidates_avx2(h, i, m, q); mask != 0; mask &= mask - 1) {
+                const std::size_t at = i + static_cast<std::size_t>(count_trailing_zeros(mask));
+                if (ifind_verify_avx2(h, at, needle, m)) return at;
+            }
+        }
+        if (i <= last) {
+            // Overlap the last full block and drop the positions already checked.
+            const std::size_t start = last + 1 - 32;
+            for (std::uint32_t mask = ifind_candidates_avx2(h, start, m, q) >> (i - start);
+                 mask != 0; mask &= mask - 1) {
+                const std::size_t at = i + static_cast<std::size_t>(count_trailing_zeros(mask));
+                if (ifind_verify_avx2(h, at, needle, m)) return at;
+            }
+        }
+        return n;
+    }
+    std::size_t end = last + 1;
+    for (; end >= 32; end -= 32) {
+        for (std::uint32_t mask = ifind_candidates_avx2(h, end - 32, m, q); mask != 0;) {
+            const int bit = highest_bit(mask);
+            const std::size_t at = end - 32 + static_cast<std::size_t>(bit);
+            if (ifind_verify_avx2(h, at, needle, m)) return at;
+            mask &= ~(std::uint32_t{1} << bit);
+        }
+    }
+    if (end > 0) {
+        const std::uint32_t keep = (std::uint32_t{1} << end) - 1;
+        for (std::uint32_t mask = ifind_candidates_avx2(h, 0, m, q) & keep; mask != 0;) {
+            const int bit = highest_bit(mask);
+            if (ifind_verify_avx2(h, static_cast<std::size_t>(bit), needle, m))
+                return static_cast<std::size_t>(bit);
+            mask &= ~(std::uint32_t{1} << bit);
+        }
+    }
+    return n;
+}
+
+CTZ_SAFE_TARGET("sse2") inline std::size_t ascii_prefix_sse2(const char* p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        if (const unsigned m = static_cast<unsigned>(_mm_movemask_epi8(v)))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return i + ascii_prefix_swar(p + i, n - i);
+}
+
+CTZ_SAFE_TARGET("avx2") inline std::size_t ascii_prefix_avx2(const char* p, std::size_t n) noexcept {
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        if (const auto m = static_cast<std::uint32_t>(_mm256_movemask_epi8(v)))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return i + ascii_prefix_sse2(p + i, n - i);
+}
+
+CTZ_SAFE_TARGET("avx512bw") inline std::size_t ascii_prefix_avx512bw(const char* p,
+                                                                     std::size_t n) noexcept {
+    for (std::size_t i = 0; i < n; i += 64) {
+        const std::size_t rem = n - i;
+        const __mmask64 live = rem >= 64 ? ~__mmask64{0} : (__mmask64{1} << rem) - 1;
+        if (const __mmask64 m = _mm512_movepi8_mask(_mm512_maskz_loadu_epi8(live, p + i)))
+            return i + static_cast<std::size_t>(count_trailing_zeros(m));
+    }
+    return n;
+}
+
+inline bool cpu_supports(kernel_isa isa) noexcept {
+#  if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 0);
+    const int max_leaf = r[0];
+    __cpuid(r, 1);
+    const bool sse2 = (r[3] & (1 << 26)) != 0;
+    const bool osxsave = (r[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    int l7[4] = {0, 0, 0, 0};
+    if (max_leaf >= 7) __cpuidex(l7, 7, 0);
+    const bool ymm = (xcr0 & 0x06) == 0x06;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+    switch (isa) {
+    case kernel_isa::sse2:     return sse2;
+    case kernel_isa::avx2:     return ymm && (l7[1] & (1 << 5)) != 0;
+    case kernel_isa::avx512bw: return zmm && (l7[1] & (1 << 16)) != 0 && (l7[1] & (1 << 30)) != 0;
+    default:                   return true;
+    }
+#  else
+    __builtin_cpu_init();
+    switch (isa) {
+    case kernel_isa::sse2:     return __builtin_cpu_supports("sse2");
+    case kernel_isa::avx2:     return __builtin_cpu_supports("avx2");
+    case kernel_isa::avx512bw: return __builtin_cpu_supports("avx512bw");
+    default:                   return true;
+    }
+#  endif
+}
+#else
+inline bool cpu_supports(kernel_isa isa) noexcept { return isa == kernel_isa::scalar; }
+#endif
+
+// One entry per bulk operation; selected once per process.
+struct kernel_table {
+    kernel_isa isa;
+    void (*to_upper)(const char*, char*, std::size_t) noexcept;
+    void (*to_lower)(const char*, char*, std::size_t) noexcept;
+    std::size_t (*find_first)(const char*, std::size_t, const class_set&, bool) noexcept;
+    std::size_t (*find_last)(const char*, std::size_t, const class_set&, bool) noexcept;
+    std::size_t (*ifold_mismatch)(const char*, const char*, std::size_t, bool) noexcept;
+    unsigned (*ascii_fold_block32)(const char*, unsigned char*) noexcept;
+    std::size_t (*ifind_ascii)(const char*, std::size_t, const char*, std::size_t) noexcept;
+    std::size_t (*irfind_ascii)(const char*, std::size_t, const char*, std::size_t) noexcept;
+    std::size_t (*ascii_prefix)(const char*, std::size_t) noexcept;
+};
+
+inline kernel_table make_kernel_table(kernel_isa isa) noexcept {
+    switch (isa) {
+#if defined(CTZ_SAFE_X86_DISPATCH)
+    case kernel_isa::avx512bw:
+        return {isa, ascii_case_avx512bw<true>, ascii_case_avx512bw<false>,
+                find_first_avx512bw, find_last_avx512bw, ifold_mismatch_avx512bw,
+                ascii_fold_block32_avx2, ifind_ascii_avx2<false>, ifind_ascii_avx2<true>,
+                ascii_prefix_avx512bw};
+    case kernel_isa::avx2:
+        return {isa, ascii_case_avx2<true>, ascii_case_avx2<false>,
+                find_first_avx2, find_last_avx2, ifold_mismatch_avx2,
+                ascii_fold_block32_avx2, ifind_ascii_avx2<false>, ifind_ascii_avx2<true>,
+                ascii_prefix_avx2};
+    case kernel_isa::sse2:
+        // The nibble lookup needs pshufb (SSSE3), so scanning stays on SWAR.
+        return {isa, ascii_case_sse2<true>, ascii_case_sse2<false>,
+                find_first_swar, find_last_swar, ifold_mismatch_sse2,
+                ascii_fold_block32_sse2, ifind_ascii_swar<false>, ifind_ascii_swar<true>,
+                ascii_prefix_sse2};
+#endif
+    default:
+        // Portable SWAR kernels; no intrinsics.
+        return {kernel_isa::scalar, ascii_case_swar<true>, ascii_case_swar<false>,
+                find_first_swar, find_last_swar, ifold_mismatch_swar,
+                ascii_fold_block32_swar, ifind_ascii_swar<false>, ifind_ascii_swar<true>,
+                ascii_prefix_swar};
+    }
+}
+
+// Best supported ISA, unless CTZ_SAFE_KERNEL names another supported one
+// ("scalar", "sse2", "avx2", "avx512bw"). Unsupported requests are ignored
+// rather than allowed to fault.
+inline kernel_isa select_kernel_isa() noexcept {
+    constexpr kernel_isa order[] = {kernel_isa::avx512bw, kernel_isa::avx2,
+                                    kernel_isa::sse2, kernel_isa::scalar};
+#if defined(_MSC_VER) && !defined(__clang__)
+#  pragma warning(suppress : 4996)
+#endif
+    if (const char* env = std::getenv("CTZ_SAFE_KERNEL")) {
+        for (kernel_isa isa : order)
+            if (kernel_name(isa) == env && cpu_supports(isa)) return isa;
+    }
+    for (kernel_isa isa : order)
+        if (cpu_supports(isa)) return isa;
+    return kernel_isa::scalar;
+}
+
+inline const kernel_table& kernels() noexcept {
+    static const kernel_table table = make_kernel_table(select_kernel_isa());
+    return table;
+}
+
+// How does the active LC_CTYPE's case mapping relate to the ASCII helpers?
+inline ascii_fit probe_ascii_fit() noexcept {
+    return measure_ascii_fit([](int c) { return std::toupper(c); },
+                             [](int c) { return std::tolower(c); });
+}
+
+// Below this size the 512 probe calls would cost more than they save on
+// platforms where the probe result cannot be cached.
+inline constexpr std::size_t uncached_probe_min = 4096;
+
+// ascii_fit of the C library's mapping. Without a cheap way to cache the
+// probe, inputs shorter than uncached_probe_min report none and take the
+// per-byte path.
+#if defined(__GLIBC__)
+// glibc hands out immutable tables per loaded locale, and the pointers
+// follow both setlocale and uselocale, so they are a cheap cache key for
+// anything derived from them. All three are compared: a single address
+// could be reused by a different locale after freelocale / newlocale.
+struct ctype_tables {
+    const std::int32_t* upper = nullptr;
+    const std::int32_t* lower = nullptr;
+    const unsigned short* classes = nullptr;
+
+    [[nodiscard]] static ctype_tables current() noexcept {
+        // The slots are per-thread variables inside glibc, so their
+        // addresses are fixed for the thread; only their contents change.
+        thread_local const std::int32_t** const upper_slot = __ctype_toupper_loc();
+        thread_local const std::int32_t** const lower_slot = __ctype_tolower_loc();
+        thread_local const unsigned short** const classes_slot = __ctype_b_loc();
+        return {*upper_slot, *lower_slot, *classes_slot};
+    }
+    friend bool operator==(const ctype_tables& a, const ctype_tables& b) noexcept {
+        return a.upper == b.upper && a.lower == b.lower && a.classes == b.classes;
+    }
+    friend bool operator!=(const ctype_tables& a, const ctype_tables& b) noexcept { return !(a == b); }
+};
+#endif
+
+inline ascii_fit ctype_ascii_fit(std::size_t n) noexcept {
+#if defined(__GLIBC__)
+    thread_local ctype_tables key;
+    thread_local ascii_fit fit = ascii_fit::none;
+    const ctype_tables now = ctype_tables::current();
+    if (now != key) {
+        fit = probe_ascii_fit();
+        key = now;
+    }
+    (void)n;
+    return fit;
+#else
+    return n >= uncached_probe_min ? probe_ascii_fit() : ascii_fit::none;
+#endif
+}
+
+// Tables for the C library's current mapping, for callers that must not
+// go through <cctype> per byte. glibc caches the result per thread; other
+// platforms build and intern a snapshot on every call, so publish one
+// with refresh_locale() where that matters.
+inline const locale_snapshot* ctype_snapshot() {
+#if defined(__GLIBC__)
+    thread_local ctype_tables key;
+    thread_local const locale_snapshot* snapshot = nullptr;
+    const ctype_tables now = ctype_tables::current();
+    if (snapshot == nullptr || now != key) {
+        snapshot = intern_locale();
+        key = now;
+    }
+    return snapshot;
+#else
+    return intern_locale();
+#endif
+}
+
+// ascii_fit of the mapping to_upper / to_lower currently use.
+inline ascii_fit active_ascii_fit(std::size_t n) noexcept {
+    if (const auto* loc = published_locale()) return loc->case_fit();
+    return ctype_ascii_fit(n);
+}
+
+// Bytes handed to map() after each ASCII run under ascii_fit::low_half.
+inline constexpr std::size_t locale_block = 64;
+
+// Converts [src, src+n) into [dst, dst+n) in one pass; src == dst converts
+// in place. With ascii_fit::all the ASCII kernel covers every byte. With
+// low_half, runs of bytes below 0x80 go through it and each run is
+// followed by one block, starting at the first high byte, that goes
+// through map(). With none, every byte goes through map().
+template <bool Upper, class Map>
+inline void convert_case(const char* src, char* dst, std::size_t n, ascii_fit fit, Map map,
+                         case_stats* stats) noexcept {
+    std::size_t ascii_bytes = 0;
+    if (fit == ascii_fit::all) {
+        if (n <= short_input_max)
+            ascii_case_swar<Upper>(src, dst, n);
+        else
+            (Upper ? kernels().to_upper : kernels().to_lower)(src, dst, n);
+        ascii_bytes = n;
+    } else if (fit == ascii_fit::low_half) {
+        const auto& k = kernels();
+        const auto ascii = Upper ? k.to_upper : k.to_lower;
+        for (std::size_t i = 0; i < n;) {
+            const std::size_t run = k.ascii_prefix(src + i, n - i);
+            ascii(src + i, dst + i, run);
+            ascii_bytes += run;
+            i += run;
+            const std::size_t end = i + std::min(locale_block, n - i);
+            for (; i < end; ++i) dst[i] = map(src[i]);
+        }
+    } else {
+        for (std::size_t i = 0; i < n; ++i) dst[i] = map(src[i]);
+    }
+    if (stats != nullptr) {
+        stats->ascii_bytes += ascii_bytes;
+        stats->locale_bytes += n - ascii_bytes;
+    }
+}
+
+template <bool Upper>
+inline void convert_case(const char* src, char* dst, std::size_t n, const locale_snapshot& loc,
+                         case_stats* stats) noexcept {
+    if (Upper)
+        convert_case<true>(src, dst, n, loc.case_fit(), [&loc](char c) { return loc.to_upper(c); }, stats);
+    else
+        convert_case<false>(src, dst, n, loc.case_fit(), [&loc](char c) { return loc.to_lower(c); }, stats);
+}
+
+// Follows to_upper / to_lower: published tables if any, else <cctype>.
+template <bool Upper>
+inline void convert_case(const char* src, char* dst, std::size_t n, case_stats* stats) noexcept {
+    if (n == 0) return;
+    if (const auto* loc = published_locale()) {
+        convert_case<Upper>(src, dst, n, *loc, stats);
+        return;
+    }
+    const ascii_fit fit = ctype_ascii_fit(n);
+    if (Upper)
+        convert_case<true>(src, dst, n, fit, ctype_to_upper, stats);
+    else
+        convert_case<false>(src, dst, n, fit, ctype_to_lower, stats);
+}
+
+// In-place forms.
+template <bool Upper>
+inline void convert_case(char* p, std::size_t n, const locale_snapshot& loc,
+                         case_stats* stats) noexcept {
+    convert_case<Upper>(p, p, n, loc, stats);
+}
+template <bool Upper>
+inline void convert_case(char* p, std::size_t n, case_stats* stats) noexcept {
+    convert_case<Upper>(p, p, n, stats);
+}
+
+// Appends n bytes to s and lets fill write them, skipping the zero-fill of
+// resize() where resize_and_overwrite is available.
+template <class String, class Fill>
+inline void append_with(String& s, std::size_t n, Fill fill) {
+    const std::size_t old = s.size();
+#if defined(__cpp_lib_string_resize_and_overwrite)
+    // fill writes exactly n bytes past old, so the new size is old + n.
+    s.resize_and_overwrite(old + n, [&fill, old, n](char* p, std::size_t) noexcept {
+        fill(p + old);
+        return old + n;
+    });
+#else
+    s.resize(old + n);
+    fill(s.data() + old);
+#endif
+}
+
+// Appends sv case-mapped to out: through loc's tables, or the runtime
+// mapping when loc is null. String is any std::basic_string<char, ...>.
+template <bool Upper, class String>
+inline void append_case(String& out, std::string_view sv, const locale_snapshot* loc) {
+    append_with(out, sv.size(), [sv, loc](char* p) {
+        if (loc != nullptr)
+            convert_case<Upper>(sv.data(), p, sv.size(), *loc, nullptr);
+        else
+            convert_case<Upper>(sv.data(), p, sv.size(), nullptr);
+    });
+}
+
+template <class A, class = void>
+inline constexpr bool is_char_allocator = false;
+template <class A>
+inline constexpr bool is_char_allocator<
+    A, std::void_t<typename A::value_type, decltype(std::declval<A&>().allocate(std::size_t{}))>> =
+    std::is_same_v<typename A::value_type, char>;
+
+} // namespace detail
+
+// Kernel chosen for this process, e.g. for logging alongside benchmarks.
+[[nodiscard]] inline kernel_isa active_kernel() noexcept {
+    return detail::kernels().isa;
+}
+
+// True if every byte is below 0x80 (vectorized high-bit test).
+[[nodiscard]] inline bool is_ascii(std::string_view sv) noexcept {
+    return detail::kernels().ascii_prefix(sv.data(), sv.size()) == sv.size();
+}
+
+// ------------------------------
+// In-place transforms over ranges/containers
+// ------------------------------
+// Overloads for std::string. Runs of ASCII go through the SIMD kernels;
+// only blocks holding bytes >= 0x80 take the per-byte locale path, and
+// only when the locale maps those bytes differently from ASCII.
+inline void to_upper_inplace(std::string& s) {
+    detail::convert_case<true>(s.data(), s.size(), nullptr);
+}
+inline void to_lower_inplace(std::string& s) {
+    detail::convert_case<false>(s.data(), s.size(), nullptr);
+}
+
+// Same, adding the bytes each path converted to stats.
+inline void to_upper_inplace(std::string& s, case_stats& stats) {
+    detail::convert_case<true>(s.data(), s.size(), &stats);
+}
+inline void to_lower_inplace(std::string& s, case_stats& stats) {
+    detail::convert_case<false>(s.data(), s.size(), &stats);
+}
+
+// Overloads for std::string using a locale_snapshot's tables
+inline void to_upper_inplace(std::string& s, const locale_snapshot& loc) {
+    detail::convert_case<true>(s.data(), s.size(), loc, nullptr);
+}
+inline void to_lower_inplace(std::string& s, const locale_snapshot& loc) {
+    detail::convert_case<false>(s.data(), s.size(), loc, nullptr);
+}
+
+// Defined with the iterator overloads below.
+template <class It>
+inline void to_upper_inplace(It first, It last, const locale_snapshot& loc);
+template <class It>
+inline void to_lower_inplace(It first, It last, const locale_snapshot& loc);
+
+namespace detail {
+// Iterators over adjacent chars, whose ranges can go to the span kernels.
+// C++20 builds accept any std::contiguous_iterator; C++17 builds know
+// pointers (which covers std::array on the common libraries) and the
+// string and vector<char> iterators.
+template <class It>
+inline constexpr bool is_contiguous_char_iterator =
+#if defined(__cpp_lib_ranges)
+    std::contiguous_iterator<It> && std::is_same_v<std::iter_reference_t<It>, char&>;
+#else
+    std::is_same_v<It, char*> || std::is_same_v<It, std::string::iterator> ||
+    std::is_same_v<It, std::vector<char>::iterator>;
+#endif
+} // namespace detail
+
+// Generic iterator pair (works with vector<char>, string, etc.). Contiguous
+// iterators take the same kernels as the std::string overloads.
+template <class It>
+inline void to_upper_inplace(It first, It last) {
+    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same_v<Char, char>,
+                  "to_upper_inplace(It,It) expects iterators over char");
+    if constexpr (detail::is_contiguous_char_iterator<It>) {
+        if (first != last)
+            detail::convert_case<true>(&*first, static_cast<std::size_t>(last - first), nullptr);
+        return;
+    }
+    if (const auto* loc = detail::published_locale()) {
+        to_upper_inplace(first, last, *loc);
+        return;
+    }
+    std::transform(first, last, first,
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+}
+
+template <class It>
+inline void to_lower_inplace(It first, It last) {
+    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same_v<Char, char>,
+                  "to_lower_inplace(It,It) expects iterators over char");
+    if constexpr (detail::is_contiguous_char_iterator<It>) {
+        if (first != last)
+            detail::convert_case<false>(&*first, static_cast<std::size_t>(last - first), nullptr);
+        return;
+    }
+    if (const auto* loc = detail::published_locale()) {
+        to_lower_inplace(first, last, *loc);
+        return;
+    }
+    std::transform(first, last, first,
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+}
+
+template <class It>
+inline void to_upper_inplace(It first, It last, const locale_snapshot& loc) {
+    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same_v<Char, char>,
+                  "to_upper_inplace(It,It,loc) expects iterators over char");
+    if constexpr (detail::is_contiguous_char_iterator<It>) {
+        if (first != last)
+            detail::convert_case<true>(&*first, static_cast<std::size_t>(last - first), loc, nullptr);
+        return;
+    }
+    std::transform(first, last, first, [&loc](char c) { return loc.to_upper(c); });
+}
+
+template <class It>
+inline void to_lower_inplace(It first, It last, const locale_snapshot& loc) {
+    using Char = std::remove_cv_t<std::remove_reference_t<decltype(*first)>>;
+    static_assert(std::is_same_v<Char, char>,
+                  "to_lower_inplace(It,It,loc) expects iterators over char");
+    if constexpr (detail::is_contiguous_char_iterator<It>) {
+        if (first != last)
+            detail::convert_case<false>(&*first, static_cast<std::size_t>(last - first), loc, nullptr);
+        return;
+    }
+    std::transform(first, last, first, [&loc](char c) { return loc.to_lower(c); });
+}
+
+// Copying transforms (return a new string). Each byte is read from sv and
+// written to the result once.
+[[nodiscard]] inline std::string to_upper_copy(std::string_view sv) {
+    std::string out;
+    detail::append_case<true>(out, sv, nullptr);
+    return out;
+}
+[[nodiscard]] inline std::string to_lower_copy(std::string_view sv) {
+    std::string out;
+    detail::append_case<false>(out, sv, nullptr);
+    return out;
+}
+[[nodiscard]] inline std::string to_upper_copy(std::string_view sv, const locale_snapshot& loc) {
+    std::string out;
+    detail::append_case<true>(out, sv, &loc);
+    return out;
+}
+[[nodiscard]] inline std::string to_lower_copy(std::string_view sv, const locale_snapshot& loc) {
+    std::string out;
+    detail::append_case<false>(out, sv, &loc);
+    return out;
+}
+
+// Same, allocating the result from alloc:
+//   auto s = ctz::safe::to_upper_copy(sv, arena_alloc);
+//   auto t = ctz::safe::to_upper_copy<my_traits>(sv, arena_alloc);
+template <class Traits = std::char_traits<char>, class Alloc,
+          std::enable_if_t<detail::is_char_allocator<Alloc>, int> = 0>
+[[nodiscard]] inline std::basic_string<char, Traits, Alloc> to_upper_copy(std::string_view sv,
+                                                                          const Alloc& alloc) {
+    std::basic_string<char, Traits, Alloc> out(alloc);
+    detail::append_case<true>(out, sv, nullptr);
+    return out;
+}
+template <class Traits = std::char_traits<char>, class Alloc,
+          std::enable_if_t<detail::is_char_allocator<Alloc>, int> = 0>
+[[nodiscard]] inline std::basic_string<char, Traits, Alloc> to_lower_copy(std::string_view sv,
+                                                                          const Alloc& alloc) {
+    std::basic_string<char, Traits, Alloc> out(alloc);
+    detail::append_case<false>(out, sv, nullptr);
+    return out;
+}
+template <class Traits = std::char_traits<char>, class Alloc,
+          std::enable_if_t<detail::is_char_allocator<Alloc>, int> = 0>
+[[nodiscard]] inline std::basic_string<char, Traits, Alloc> to_upper_copy(
+    std::string_view sv, const locale_snapshot& loc, const Alloc& alloc) {
+    std::basic_string<char, Traits, Alloc> out(alloc);
+    detail::append_case<true>(out, sv, &loc);
+    return out;
+}
+template <class Traits = std::char_traits<char>, class Alloc,
+          std::enable_if_t<detail::is_char_allocator<Alloc>, int> = 0>
+[[nodiscard]] inline std::basic_string<char, Traits, Alloc> to_lower_copy(
+    std::string_view sv, const locale_snapshot& loc, const Alloc& alloc) {
+    std::basic_string<char, Traits, Alloc> out(alloc);
+    detail::append_case<false>(out, sv, &loc);
+    return out;
+}
+
+#if defined(__cpp_lib_memory_resource)
+// std::pmr::string from a memory resource, e.g. a per-request
+// monotonic_buffer_resource, with no global heap traffic.
+[[nodiscard]] inline std::pmr::string to_upper_copy(std::string_view sv,
+                                                    std::pmr::memory_resource* mr) {
+    return to_upper_copy(sv, std::pmr::polymorphic_allocator<char>(mr));
+}
+[[nodiscard]] inline std::pmr::string to_lower_copy(std::string_view sv,
+                                                    std::pmr::memory_resource* mr) {
+    return to_lower_copy(sv, std::pmr::polymorphic_allocator<char>(mr));
+}
+[[nodiscard]] inline std::pmr::string to_upper_copy(std::string_view sv, const locale_snapshot& loc,
+                                                    std::pmr::memory_resource* mr) {
+    return to_upper_copy(sv, loc, std::pmr::polymorphic_allocator<char>(mr));
+}
+[[nodiscard]] inline std::pmr::string to_lower_copy(std::string_view sv, const locale_snapshot& loc,
+                                                    std::pmr::memory_resource* mr) {
+    return to_lower_copy(sv, loc, std::pmr::polymorphic_allocator<char>(mr));
+}
+#endif
+
+// Rvalue strings are converted in their own buffer and moved out. These
+// are templates so that string literals still pick the string_view forms.
+template <class S, std::enable_if_t<std::is_same_v<S, std::string>, int> = 0>
+[[nodiscard]] inline std::string to_upper_copy(S&& s) {
+    to_upper_inplace(s);
+    return std::move(s);
+}
+template <class S, std::enable_if_t<std::is_same_v<S, std::string>, int> = 0>
+[[nodiscard]] inline std::string to_lower_copy(S&& s) {
+    to_lower_inplace(s);
+    return std::move(s);
+}
+template <class S, std::enable_if_t<std::is_same_v<S, std::string>, int> = 0>
+[[nodiscard]] inline std::string to_upper_copy(S&& s, const locale_snapshot& loc) {
+    to_upper_inplace(s, loc);
+    return std::move(s);
+}
+template <class S, std::enable_if_t<std::is_same_v<S, std::string>, int> = 0>
+[[nodiscard]] inline std::string to_lower_copy(S&& s, const locale_snapshot& loc) {
+    to_lower_inplace(s, loc);
+    return std::move(s);
+}
+
+// Transforms into caller memory, with the same kernels. These append to dst
+// and only allocate when its capacity is too small; src must not point
+// into dst.
+inline void to_upper_into(std::string_view src, std::string& dst) {
+    detail::append_case<true>(dst, src, nullptr);
+}
+inline void to_lower_into(std::string_view src, std::string& dst) {
+    detail::append_case<false>(dst, src, nullptr);
+}
+inline void to_upper_into(std::string_view src, std::string& dst, const locale_snapshot& loc) {
+    detail::append_case<true>(dst, src, &loc);
+}
+inline void to_lower_into(std::string_view src, std::string& dst, const locale_snapshot& loc) {
+    detail::append_case<false>(dst, src, &loc);
+}
+
+#if defined(__cpp_lib_span)
+// Writes min(src.size(), dst.size()) bytes to the front of dst and returns
+// that part of dst; compare its size with src.size() to detect truncation.
+// src may equal dst but must not otherwise overlap it.
+inline std::span<char> to_upper_into(std::string_view src, std::span<char> dst) noexcept {
+    const std::size_t n = std::min(src.size(), dst.size());
+    detail::convert_case<true>(src.data(), dst.data(), n, nullptr);
+    return dst.first(n);
+}
+inline std::span<char> to_lower_into(std::string_view src, std::span<char> dst) noexcept {
+    const std::size_t n = std::min(src.size(), dst.size());
+    detail::convert_case<false>(src.data(), dst.data(), n, nullptr);
+    return dst.first(n);
+}
+inline std::span<char> to_upper_into(std::string_view src, std::span<char> dst,
+                                     const locale_snapshot& loc) noexcept {
+    const std::size_t n = std::min(src.size(), dst.size());
+    detail::convert_case<true>(src.data(), dst.data(), n, loc, nullptr);
+    return dst.first(n);
+}
+inline std::span<char> to_lower_into(std::string_view src, std::span<char> dst,
+                                     const locale_snapshot& loc) noexcept {
+    const std::size_t n = std::min(src.size(), dst.size());
+    detail::convert_case<false>(src.data(), dst.data(), n, loc, nullptr);
+    return dst.first(n);
+}
+#endif
+
+// ------------------------------
+// Class-span scanners
+// ------------------------------
+// find_*_of_class(sv, mask) return the position of the first/last byte that
+// belongs (or does not belong) to any class in mask. Positions and the pos
+// argument behave as in std::string_view::find_first_of / find_last_of, and
+// std::string_view::npos means no match. The class_set overloads take a
+// prebuilt set, e.g. one built from a locale_snapshot.
+namespace detail {
+// A mask together with the tables it is tested against: the published
+// ones when bound, else the C library's. Binding once per call keeps a
+// scan that tests many bytes, or makes several passes, on one locale
+// while refresh_locale runs in another thread.
+struct bound_mask {
+    char_class mask;
+    const locale_snapshot* loc;
+};
+
+inline bound_mask bind_mask(char_class mask) noexcept {
+    return {mask, published_locale()};
+}
+inline bool in_class(char ch, const bound_mask& m) noexcept {
+    return m.loc != nullptr ? m.loc->is(ch, m.mask) : ctype_is_any(ch, m.mask);
+}
+
+// Identity of the class table m is tested against, or null if it cannot
+// be observed cheaply.
+inline const void* class_table_key(const bound_mask& m) noexcept {
+    if (m.loc != nullptr) return m.loc;
+#if defined(__GLIBC__)
+    return *__ctype_b_loc();
+#else
+    return nullptr;
+#endif
+}
+
+// Per-thread cache of the class_sets recently scanned for, keyed on the
+// class table they were built from. Null when the set is not worth
+// building for n bytes.
+inline const class_set* class_set_for(const bound_mask& m, std::size_t n) noexcept {
+    struct entry {
+        const void* key = nullptr;
+        char_class mask = char_class::none;
+        class_set set;
+    };
+    thread_local entry cache[8];
+    thread_local unsigned next = 0;
+    const auto build = [&m] {
+        if (m.loc != nullptr) return class_set(m.mask, *m.loc);
+        class_set set;
+        for (int c = 0; c < 256; ++c)
+            if (ctype_is_any(static_cast<char>(c), m.mask)) set.insert(static_cast<char>(c));
+        return set;
+    };
+    const void* key = class_table_key(m);
+    if (key == nullptr) {
+        if (n < uncached_probe_min) return nullptr;
+        cache[0] = {nullptr, m.mask, build()};
+        return &cache[0].set;
+    }
+    for (const entry& e : cache)
+        if (e.key == key && e.mask == m.mask) return &e.set;
+    entry& e = cache[next++ % 8];
+    e = {key, m.mask, build()};
+    return &e.set;
+}
+
+// The byte-at-a-time form, for when no class_set is at hand.
+template <class Pred>
+inline std::size_t find_class_if(std::string_view sv, std::size_t pos, bool first, bool member,
+                                 Pred in_class) noexcept {
+    if (first) {
+        for (std::size_t i = pos; i < sv.size(); ++i)
+            if (in_class(sv[i]) == member) return i;
+    } else if (!sv.empty()) {
+        for (std::size_t i = std::min(pos, sv.size() - 1) + 1; i-- > 0;)
+            if (in_class(sv[i]) == member) return i;
+    }
+    return std::string_view::npos;
+}
+
+inline std::size_t find_class(std::string_view sv, const class_set& set, std::size_t pos,
+                              bool first, bool member) noexcept {
+    if (first) {
+        if (pos >= sv.size()) return std::string_view::npos;
+        const std::size_t n = sv.size() - pos;
+        const std::size_t i = kernels().find_first(sv.data() + pos, n, set, member);
+        return i == n ? std::string_view::npos : pos + i;
+    }
+    if (sv.empty()) return std::string_view::npos;
+    const std::size_t n = std::min(pos, sv.size() - 1) + 1;
+    const std::size_t i = kernels().find_last(sv.data(), n, set, member);
+    return i == n ? std::string_view::npos : i;
+}
+
+inline std::size_t find_class(std::string_view sv, const bound_mask& m, std::size_t pos, bool first,
+                              bool member) noexcept {
+    if (const class_set* set = class_set_for(m, sv.size()))
+        return find_class(sv, *set, pos, first, member);
+    return find_class_if(sv, pos, first, member, [&m](char ch) { return in_class(ch, m); });
+}
+
+inline std::size_t find_class(std::string_view sv, char_class mask, std::size_t pos, bool first,
+                              bool member) noexcept {
+    return find_class(sv, bind_mask(mask), pos, first, member);
+}
+} // namespace detail
+
+[[nodiscard]] inline std::size_t find_first_of_class(std::string_view sv, char_class mask,
+                                                     std::size_t pos = 0) noexcept {
+    return detail::find_class(sv, mask, pos, true, true);
+}
+[[nodiscard]] inline std::size_t find_first_not_of_class(std::string_view sv, char_class mask,
+                                                         std::size_t pos = 0) noexcept {
+    return detail::find_class(sv, mask, pos, true, false);
+}
+[[nodiscard]] inline std::size_t find_last_of_class(std::string_view sv, char_class mask,
+                                                    std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(sv, mask, pos, false, true);
+}
+[[nodiscard]] inline std::size_t find_last_not_of_class(std::string_view sv, char_class mask,
+                                                        std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(sv, mask, pos, false, false);
+}
+
+[[nodiscard]] inline std::size_t find_first_of_class(std::string_view sv, const class_set& set,
+                                                     std::size_t pos = 0) noexcept {
+    return detail::find_class(sv, set, pos, true, true);
+}
+[[nodiscard]] inline std::size_t find_first_not_of_class(std::string_view sv, const class_set& set,
+                                                         std::size_t pos = 0) noexcept {
+    return detail::find_class(sv, set, pos, true, false);
+}
+[[nodiscard]] inline std::size_t find_last_of_class(std::string_view sv, const class_set& set,
+                                                    std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(sv, set, pos, false, true);
+}
+[[nodiscard]] inline std::size_t find_last_not_of_class(std::string_view sv, const class_set& set,
+                                                        std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(sv, set, pos, false, false);
+}
+
+// True when every byte of sv belongs to the class (and for empty sv).
+[[nodiscard]] inline bool all_of_class(std::string_view sv, char_class mask) noexcept {
+    return find_first_not_of_class(sv, mask) == std::string_view::npos;
+}
+[[nodiscard]] inline bool all_of_class(std::string_view sv, const class_set& set) noexcept {
+    return find_first_not_of_class(sv, set) == std::string_view::npos;
+}
+
+// ------------------------------
+// Batch transforms
+// ------------------------------
+// to_upper_batch / to_lower_batch convert many short strings per call. The
+// results are packed back to back into one buffer, so there is no
+// allocation per string, and the kernels sweep that buffer in large
+// blocks instead of paying the per-call setup for each string. A
+// string_batch can be reused across calls and keeps its capacity.
+//
+//   ctz::safe::string_batch out;
+//   ctz::safe::to_lower_batch(tokens, out, char_class::alnum);
+//   for (std::size_t i = 0; i < out.size(); ++i)
+//       if (out.in_class[i]) use(out[i]);
+struct string_batch {
+    std::string bytes;                 // all results, back to back
+    std::vector<std::size_t> offsets;  // result i is [offsets[i], offsets[i+1])
+    std::vector<bool> in_class;        // per result, when a mask was given
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+    [[nodiscard]] std::string_view operator[](std::size_t i) const noexcept {
+        return {bytes.data() + offsets[i], offsets[i + 1] - offsets[i]};
+    }
+};
+
+namespace detail {
+// Calls outside(i) for each row i in [0, rows) holding a byte outside
+// mask, where row i is data[offsets[i], offsets[i+1]). One scan covers all
+// rows; after a hit it resumes at the next row.
+template <class Offset, class Outside>
+inline void rows_outside_class(const char* data, const Offset* offsets, std::size_t rows,
+                               char_class mask, Outside outside) noexcept {
+    if (rows == 0) return;
+    const auto base = static_cast<std::size_t>(offsets[0]);
+    const auto end = [offsets, base](std::size_t i) {
+        return static_cast<std::size_t>(offsets[i + 1]) - base;
+    };
+    const std::string_view all(data + base, end(rows - 1));
+    const bound_mask m = bind_mask(mask);
+    std::size_t i = 0;
+    for (std::size_t pos = find_class(all, m, 0, true, false); pos != std::string_view::npos;) {
+        while (end(i) <= pos) ++i;
+        outside(i);
+        pos = find_class(all, m, end(i), true, false);
+    }
+}
+
+// Strings are gathered and converted in blocks of about this many bytes,
+// so each block is still in cache when the kernel runs over it.
+inline constexpr std::size_t batch_block = 16 * 1024;
+
+template <bool Upper, class Strings>
+inline void case_batch(const Strings& items, string_batch& out, const char_class* mask) {
+    out.offsets.clear();
+    out.offsets.push_back(0);
+    std::size_t total = 0;
+    for (const auto& item : items) {
+        total += std::string_view(item).size();
+        out.offsets.push_back(total);
+    }
+    out.bytes.clear();
+    append_with(out.bytes, total, [&items, total](char* p) {
+        const locale_snapshot* loc = published_locale();
+        const ascii_fit fit = loc != nullptr ? loc->case_fit() : ctype_ascii_fit(total);
+        if (fit == ascii_fit::all) {
+            // ASCII mapping: convert straight from each source, short ones inline.
+            const auto kernel = Upper ? kernels().to_upper : kernels().to_lower;
+            for (const auto& item : items) {
+                const std::string_view sv(item);
+                if (sv.size() <= short_input_max)
+                    ascii_case_swar<Upper>(sv.data(), p, sv.size());
+                else
+                    kernel(sv.data(), p, sv.size());
+                p += sv.size();
+            }
+            return;
+        }
+        // Every block goes through the mapping picked above: loc's tables,
+        // or <cctype> with the fit probed once for the whole batch.
+        const auto convert = [loc, fit](char* q, std::size_t n) {
+            if (loc != nullptr)
+                convert_case<Upper>(q, n, *loc, nullptr);
+            else if (Upper)
+                convert_case<true>(q, q, n, fit, ctype_to_upper, nullptr);
+            else
+                convert_case<false>(q, q, n, fit, ctype_to_lower, nullptr);
+        };
+        char* block = p;
+        for (const auto& item : items) {
+            const std::string_view sv(item);
+            if (!sv.empty()) std::memcpy(p, sv.data(), sv.size());
+            p += sv.size();
+            if (static_cast<std::size_t>(p - block) >= batch_block) {
+                convert(block, static_cast<std::size_t>(p - block));
+                block = p;
+            }
+        }
+        convert(block, static_cast<std::size_t>(p - block));
+    });
+
+    out.in_class.clear();
+    if (mask == nullptr) return;
+    out.in_class.assign(out.size(), true);
+    rows_outside_class(out.bytes.data(), out.offsets.data(), out.size(), *mask,
+                       [&out](std::size_t i) { out.in_class[i] = false; });
+}
+} // namespace detail
+
+// items is any range of values convertible to std::string_view, e.g. a
+// std::vector<std::string> or a std::span<const std::string_view>; none
+// may point into out.bytes.
+template <class Strings>
+inline void to_upper_batch(const Strings& items, string_batch& out) {
+    detail::case_batch<true>(items, out, nullptr);
+}
+template <class Strings>
+inline void to_lower_batch(const Strings& items, string_batch& out) {
+    detail::case_batch<false>(items, out, nullptr);
+}
+
+// Also sets out.in_class[i] when every byte of result i is in mask, as
+// is_any(ch, mask) would report; empty results count as in class.
+template <class Strings>
+inline void to_upper_batch(const Strings& items, string_batch& out, char_class mask) {
+    detail::case_batch<true>(items, out, &mask);
+}
+template <class Strings>
+inline void to_lower_batch(const Strings& items, string_batch& out, char_class mask) {
+    detail::case_batch<false>(items, out, &mask);
+}
+
+// ------------------------------
+// Trimming
+// ------------------------------
+// trim / trim_left / trim_right drop leading and/or trailing bytes that
+// belong to mask: whitespace by default, with the same meaning as is_space.
+// The string_view forms never copy; the _inplace forms erase from the
+// string. For a snapshot, pass class_set(char_class::space, loc).
+namespace detail {
+inline bool in_class(char ch, const class_set& set) noexcept { return set.contains(ch); }
+
+template <class Set>
+inline std::string_view trim_view(std::string_view sv, const Set& set, bool left,
+                                  bool right) noexcept {
+    std::size_t b = 0;
+    std::size_t e = sv.size();
+    if (e <= short_input_max) {
+        if (left)
+            while (b < e && in_class(sv[b], set)) ++b;
+        if (right)
+            while (e > b && in_class(sv[e - 1], set)) --e;
+        return sv.substr(b, e - b);
+    }
+    if (left) {
+        b = find_class(sv, set, 0, true, false);
+        if (b == std::string_view::npos) return sv.substr(sv.size());
+    }
+    if (right) {
+        const std::size_t last = find_class(sv, set, std::string_view::npos, false, false);
+        e = last == std::string_view::npos ? b : last + 1;
+    }
+    return sv.substr(b, e - b);
+}
+
+inline void keep_only(std::string& s, std::string_view kept) {
+    const auto offset = static_cast<std::size_t>(kept.data() - s.data());
+    s.erase(offset + kept.size());
+    s.erase(0, offset);
+}
+} // namespace detail
+
+[[nodiscard]] inline std::string_view trim(std::string_view sv,
+                                           char_class mask = char_class::space) noexcept {
+    return detail::trim_view(sv, detail::bind_mask(mask), true, true);
+}
+[[nodiscard]] inline std::string_view trim_left(std::string_view sv,
+                                                char_class mask = char_class::space) noexcept {
+    return detail::trim_view(sv, detail::bind_mask(mask), true, false);
+}
+[[nodiscard]] inline std::string_view trim_right(std::string_view sv,
+                                                 char_class mask = char_class::space) noexcept {
+    return detail::trim_view(sv, detail::bind_mask(mask), false, true);
+}
+[[nodiscard]] inline std::string_view trim(std::string_view sv, const class_set& set) noexcept {
+    return detail::trim_view(sv, set, true, true);
+}
+[[nodiscard]] inline std::string_view trim_left(std::string_view sv, const class_set& set) noexcept {
+    return detail::trim_view(sv, set, true, false);
+}
+[[nodiscard]] inline std::string_view trim_right(std::string_view sv, const class_set& set) noexcept {
+    return detail::trim_view(sv, set, false, true);
+}
+
+inline void trim_inplace(std::string& s, char_class mask = char_class::space) {
+    detail::keep_only(s, trim(s, mask));
+}
+inline void trim_left_inplace(std::string& s, char_class mask = char_class::space) {
+    detail::keep_only(s, trim_left(s, mask));
+}
+inline void trim_right_inplace(std::string& s, char_class mask = char_class::space) {
+    detail::keep_only(s, trim_right(s, mask));
+}
+inline void trim_inplace(std::string& s, const class_set& set) {
+    detail::keep_only(s, trim(s, set));
+}
+inline void trim_left_inplace(std::string& s, const class_set& set) {
+    detail::keep_only(s, trim_left(s, set));
+}
+inline void trim_right_inplace(std::string& s, const class_set& set) {
+    detail::keep_only(s, trim_right(s, set));
+}
+
+// ------------------------------
+// Case-insensitive comparison
+// ------------------------------
+// Bytes compare equal when to_lower maps them to the same value. Nothing
+// is allocated: ASCII is folded and compared in SIMD blocks, and only the
+// bytes the ASCII fold cannot decide go through to_lower.
+namespace detail {
+// Index of the first byte where lower(a[i]) != lower(b[i]), or n; fit
+// describes how lower relates to ascii_to_lower.
+template <class Lower>
+inline std::size_t imismatch(const char* a, const char* b, std::size_t n, ascii_fit fit,
+                             Lower lower) noexcept {
+    if (fit == ascii_fit::none) {
+        for (std::size_t i = 0; i < n; ++i)
+            if (lower(a[i]) != lower(b[i])) return i;
+        return n;
+    }
+    const bool stop_at_high = fit != ascii_fit::all;
+    const auto& k = kernels();
+    for (std::size_t i = 0;;) {
+        i += k.ifold_mismatch(a + i, b + i, n - i, stop_at_high);
+        if (i == n || lower(a[i]) != lower(b[i])) return i;
+        ++i;
+    }
+}
+
+// Calls f(fit, lower) with the mapping to_lower uses right now, for a call
+// that folds n bytes. The published tables are loaded once, so one call
+// never mixes two locales while refresh_locale runs in another thread.
+template <class F>
+inline decltype(auto) with_active_lower(std::size_t n, F f) {
+    if (const auto* loc = published_locale())
+        return f(loc->case_fit(), [loc](char c) { return loc->to_lower(c); });
+    return f(ctype_ascii_fit(n), ctype_to_lower);
+}
+
+// Same, for to_lower.
+inline std::size_t imismatch(const char* a, const char* b, std::size_t n) noexcept {
+    if (n == 0) return 0;
+    return with_active_lower(n, [&](ascii_fit fit, auto lower) { return imismatch(a, b, n, fit, lower); });
+}
+} // namespace detail
+
+[[nodiscard]] inline bool iequals(std::string_view a, std::string_view b) noexcept {
+    return a.size() == b.size() && detail::imismatch(a.data(), b.data(), a.size()) == a.size();
+}
+
+// Negative, zero or positive like std::string_view::compare, ordering the
+// folded bytes as unsigned char.
+[[nodiscard]] inline int icompare(std::string_view a, std::string_view b) noexcept {
+    const std::size_t n = std::min(a.size(), b.size());
+    return detail::with_active_lower(n, [&](ascii_fit fit, auto lower) {
+        const std::size_t i = detail::imismatch(a.data(), b.data(), n, fit, lower);
+        if (i < n) {
+            const auto x = static_cast<unsigned char>(lower(a[i]));
+            const auto y = static_cast<unsigned char>(lower(b[i]));
+            return x < y ? -1 : 1;
+        }
+        return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+    });
+}
+
+// ifind / irfind behave like std::string_view::find / rfind on the folded
+// bytes: pos bounds the start of the match, and npos means no match. When
+// the locale's case mapping is plain ASCII, short needles go through a SIMD
+// first/last-byte candidate filter. Long needles, and any locale that the
+// ASCII fold cannot decide, use Horspool over to_lower-folded bytes.
+namespace detail {
+// From this needle length on, Horspool's skips beat the candidate filter.
+inline constexpr std::size_t horspool_min = 32;
+
+// Match starting in [from, last] of h, scanning forward or backward; fit
+// describes how lower relates to ascii_to_lower, as for imismatch.
+template <class Lower>
+inline std::size_t ifind_horspool(const char* h, std::size_t from, std::size_t last,
+                                  const char* needle, std::size_t m, bool reverse, ascii_fit fit,
+                                  Lower lower) noexcept {
+    const auto fold_byte = [&lower](char ch) { return static_cast<unsigned char>(lower(ch)); };
+    std::size_t skip[256];
+    std::fill(skip, skip + 256, m);
+    if (!reverse) {
+        for (std::size_t k = 0; k + 1 < m; ++k) skip[fold_byte(needle[k])] = m - 1 - k;
+        const unsigned char tail = fold_byte(needle[m - 1]);
+        for (std::size_t i = from; i <= last;) {
+            const unsigned char c = fold_byte(h[i + m - 1]);
+            if (c == tail && imismatch(h + i, needle, m - 1, fit, lower) == m - 1) return i;
+            i += skip[c];
+        }
+    } else {
+        for (std::size_t k = m - 1; k > 0; --k) skip[fold_byte(needle[k])] = k;
+        const unsigned char head = fold_byte(needle[0]);
+        for (std::size_t i = last;;) {
+            const unsigned char c = fold_byte(h[i]);
+            if (c == head && imismatch(h + i + 1, needle + 1, m - 1, fit, lower) == m - 1) return i;
+            if (i < from + skip[c]) break;
+            i -= skip[c];
+        }
+    }
+    return std::string_view::npos;
+}
+
+template <class Lower>
+inline std::size_t ifind_range(std::string_view hay, std::string_view needle, std::size_t from,
+                               std::size_t last, bool reverse, ascii_fit fit, Lower lower) noexcept {
+    const std::size_t m = needle.size();
+    const std::size_t span = last - from + m;
+    if (m < horspool_min && fit == ascii_fit::all) {
+        const auto& k = kernels();
+        const auto find = reverse ? k.irfind_ascii : k.ifind_ascii;
+        const std::size_t i = find(hay.data() + from, span, needle.data(), m);
+        return i == span ? std::string_view::npos : from + i;
+    }
+    return ifind_horspool(hay.data(), from, last, needle.data(), m, reverse, fit, lower);
+}
+
+// Same, for to_lower.
+inline std::size_t ifind_range(std::string_view hay, std::string_view needle, std::size_t from,
+                               std::size_t last, bool reverse) noexcept {
+    return with_active_lower(last - from + needle.size(), [&](ascii_fit fit, auto lower) {
+        return ifind_range(hay, needle, from, last, reverse, fit, lower);
+    });
+}
+} // namespace detail
+
+[[nodiscard]] inline std::size_t ifind(std::string_view hay, std::string_view needle,
+                                       std::size_t pos = 0) noexcept {
+    if (pos > hay.size() || needle.size() > hay.size() - pos) return std::string_view::npos;
+    if (needle.empty()) return pos;
+    return detail::ifind_range(hay, needle, pos, hay.size() - needle.size(), false);
+}
+
+[[nodiscard]] inline std::size_t irfind(std::string_view hay, std::string_view needle,
+                                        std::size_t pos = std::string_view::npos) noexcept {
+    if (needle.size() > hay.size()) return std::string_view::npos;
+    const std::size_t last = std::min(pos, hay.size() - needle.size());
+    if (needle.empty()) return last;
+    return detail::ifind_range(hay, needle, 0, last, true);
+}
+
+[[nodiscard]] inline bool istarts_with(std::string_view s, std::string_view prefix) noexcept {
+    return s.size() >= prefix.size() && iequals(s.substr(0, prefix.size()), prefix);
+}
+[[nodiscard]] inline bool iends_with(std::string_view s, std::string_view suffix) noexcept {
+    return s.size() >= suffix.size() && iequals(s.substr(s.size() - suffix.size()), suffix);
+}
+[[nodiscard]] inline bool icontains(std::string_view hay, std::string_view needle) noexcept {
+    return ifind(hay, needle) != std::string_view::npos;
+}
+
+// ------------------------------
+// Case-insensitive hashing
+// ------------------------------
+// ihash is a 64-bit hash of the to_lower-folded bytes, so strings that
+// iequals considers equal hash equal. The SIMD kernel folds 32 bytes at a
+// time into a 32-byte block on the stack, which is mixed into four
+// xxHash64-style accumulators; no folded copy of the whole input is built.
+// Short keys in an ASCII-folding locale take a two-word SWAR path instead.
+// Values are stable within a process only.
+namespace detail {
+inline constexpr std::uint64_t hash_p1 = 0x9E3779B185EBCA87ULL;
+inline constexpr std::uint64_t hash_p2 = 0xC2B2AE3D27D4EB4FULL;
+inline constexpr std::uint64_t hash_p3 = 0x165667B19E3779F9ULL;
+inline constexpr std::uint64_t hash_p4 = 0x85EBCA77C2B2AE63ULL;
+inline constexpr std::uint64_t hash_p5 = 0x27D4EB2F165667C5ULL;
+
+constexpr std::uint64_t rotl64(std::uint64_t x, int r) noexcept {
+    return (x << r) | (x >> (64 - r));
+}
+constexpr std::uint64_t hash_round(std::uint64_t acc, std::uint64_t input) noexcept {
+    return rotl64(acc + input * hash_p2, 31) * hash_p1;
+}
+
+// Keys up to this length whose locale folds like ASCII are folded in two
+// SWAR words and mixed without the 32-byte block machinery.
+inline constexpr std::size_t hash_short_max = 16;
+
+// The folded bytes of a short key as two words: overlapping 8-byte halves
+// from 8 bytes on, 4-byte halves from 4, else the bytes themselves. With
+// the length mixed in, distinct keys give distinct pairs.
+inline std::uint64_t ihash_short(const char* p, std::size_t n) noexcept {
+    swar_word lo = 0, hi = 0;
+    if (n >= 8) {
+        lo = swar_load(p);
+        hi = swar_load(p + n - 8);
+    } else if (n >= 4) {
+        std::uint32_t a, b;
+        std::memcpy(&a, p, 4);
+        std::memcpy(&b, p + n - 4, 4);
+        lo = a;
+        hi = b;
+    } else {
+        for (std::size_t i = 0; i < n; ++i)
+            lo |= swar_word{static_cast<unsigned char>(p[i])} << (8 * i);
+    }
+    lo = swar_case<false>(lo);
+    hi = swar_case<false>(hi);
+    std::uint64_t h = rotl64(lo * hash_p1, 31) ^ (hi * hash_p2) ^ (n * hash_p5);
+    h ^= h >> 29;
+    h *= hash_p3;
+    h ^= h >> 32;
+    return h;
+}
+
+// Mixes one folded 32-byte block into the four accumulators.
+inline void hash_block(std::uint64_t (&acc)[4], const unsigned char* block) noexcept {
+    for (int j = 0; j < 4; ++j) {
+        std::uint64_t word;
+        std::memcpy(&word, block + 8 * j, 8);
+        acc[j] = hash_round(acc[j], word);
+    }
+}
+// ihash with lower as the fold; fit describes how lower relates to
+// ascii_to_lower, as for imismatch.
+template <class Lower>
+inline std::uint64_t ihash(std::string_view s, ascii_fit fit, Lower lower) noexcept {
+    const std::size_t n = s.size();
+    // The empty key hashes alike under every fit, so callers may skip the probe.
+    if (n == 0 || (n <= hash_short_max && fit == ascii_fit::all))
+        return ihash_short(s.data(), n);
+    const auto fold = kernels().ascii_fold_block32;
+    std::uint64_t acc[4] = {hash_p1 + hash_p2, hash_p2, 0, 0 - hash_p1};
+    alignas(32) unsigned char block[32];
+    const char* p = s.data();
+    for (std::size_t i = 0; i < n; i += 32) {
+        const std::size_t len = std::min<std::size_t>(32, n - i);
+        unsigned high;
+        if (len == 32) {
+            high = fold(p + i, block);
+        } else {
+            // Zero-pad the tail; the length is mixed in below.
+            char tail[32] = {};
+            std::memcpy(tail, p + i, len);
+            high = fold(tail, block);
+        }
+        if (fit == ascii_fit::none || (fit == ascii_fit::low_half && high != 0)) {
+            for (std::size_t k = 0; k < len; ++k)
+                if (fit == ascii_fit::none || (block[k] & 0x80u) != 0)
+                    block[k] = static_cast<unsigned char>(lower(p[i + k]));
+        }
+        hash_block(acc, block);
+    }
+    std::uint64_t h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+    for (std::uint64_t a : acc) h = (h ^ hash_round(0, a)) * hash_p1 + hash_p4;
+    h += static_cast<std::uint64_t>(n) * hash_p5;
+    h ^= h >> 33;
+    h *= hash_p2;
+    h ^= h >> 29;
+    h *= hash_p3;
+    h ^= h >> 32;
+    return h;
+}
+} // namespace detail
+
+[[nodiscard]] inline std::uint64_t ihash(std::string_view s) noexcept {
+    if (s.empty()) return detail::ihash_short(s.data(), 0);
+    return detail::with_active_lower(s.size(), [s](ascii_fit fit, auto lower) { return detail::ihash(s, fit, lower); });
+}
+
+// Transparent hasher and key-equal for unordered containers keyed on
+// case-insensitive strings. With C++20 heterogeneous lookup,
+// map.find(std::string_view{...}) does not allocate.
+struct ci_hash {
+    using is_transparent = void;
+    [[nodiscard]] std::size_t operator()(std::string_view s) const noexcept {
+        return static_cast<std::size_t>(ihash(s));
+    }
+};
+struct ci_equal {
+    using is_transparent = void;
+    [[nodiscard]] bool operator()(std::string_view a, std::string_view b) const noexcept {
+        return iequals(a, b);
+    }
+};
+
+// ---------------------------------
+// Algorithm-friendly functor objects
+// ---------------------------------
+struct ToUpper {
+    [[nodiscard]] char operator()(unsigned char c) const noexcept {
+        return to_upper(static_cast<char>(c));
+    }
+};
+struct ToLower {
+    [[nodiscard]] char operator()(unsigned char c) const noexcept {
+        return to_lower(static_cast<char>(c));
+    }
+};
+
+// Example:
+// std::transform(s.begin(), s.end(), s.begin(), ctz::safe::ToUpper{});
+
+// ------------------------------
+// String columns
+// ------------------------------
+// Operations over a column in the Arrow string layout: one data buffer
+// and rows + 1 offsets, row i being data[offsets[i], offsets[i+1]). Case
+// mapping is byte-local, so upper/lower run the kernels once over the
+// whole data range and the offsets stay valid. Per-row results are
+// written as Arrow-style bitmaps, bit i at bits[i / 8] >> (i % 8), with
+// (rows + 7) / 8 bytes.
+//
+// For a dictionary-encoded column, apply upper/lower/trim to the
+// dictionary and keep the indices; the _column overloads that take indices
+// evaluate the dictionary once and gather per row.
+template <class Offset>
+struct basic_string_column {
+    const char* data = nullptr;
+    const Offset* offsets = nullptr;  // rows + 1 entries, non-decreasing
+    std::size_t rows = 0;
+
+    [[nodiscard]] std::string_view operator[](std::size_t i) const noexcept {
+        return {data + offsets[i], static_cast<std::size_t>(offsets[i + 1] - offsets[i])};
+    }
+};
+using string_column = basic_string_column<std::int32_t>;        // Arrow utf8 / binary
+using large_string_column = basic_string_column<std::int64_t>;  // large_utf8 / large_binary
+
+namespace detail {
+template <bool Upper, class Offset>
+inline void case_column(const basic_string_column<Offset>& col, char* out) noexcept {
+    if (col.rows == 0) return;
+    const auto begin = static_cast<std::size_t>(col.offsets[0]);
+    const auto end = static_cast<std::size_t>(col.offsets[col.rows]);
+    convert_case<Upper>(col.data + begin, out + begin, end - begin, nullptr);
+}
+
+template <class Pred>
+inline void fill_bits(std::uint8_t* bits, std::size_t rows, Pred pred) noexcept {
+    if (rows == 0) return;
+    std::memset(bits, 0, (rows + 7) / 8);
+    for (std::size_t i = 0; i < rows; ++i)
+        if (pred(i)) bits[i / 8] |= static_cast<std::uint8_t>(1u << (i % 8));
+}
+
+[[nodiscard]] inline bool test_bit(const std::uint8_t* bits, std::size_t i) noexcept {
+    return (bits[i / 8] >> (i % 8)) & 1u;
+}
+} // namespace detail
+
+// Writes the converted data range to out, at the same offsets as in
+// col.data (out may be col.data itself). Bytes outside
+// [offsets[0], offsets[rows]) are not touched.
+template <class Offset>
+inline void to_upper_column(const basic_string_column<Offset>& col, char* out) noexcept {
+    detail::case_column<true>(col, out);
+}
+template <class Offset>
+inline void to_lower_column(const basic_string_column<Offset>& col, char* out) noexcept {
+    detail::case_column<false>(col, out);
+}
+
+// Builds a trimmed copy of the column: out_data and out_offsets (rows + 1
+// entries, starting at 0) are replaced and keep their capacity.
+template <class Offset>
+inline void trim_column(const basic_string_column<Offset>& col, std::string& out_data,
+                        std::vector<Offset>& out_offsets, char_class mask = char_class::space) {
+    out_data.clear();
+    out_offsets.resize(col.rows + 1);
+    out_offsets[0] = 0;
+    if (col.rows == 0) return;
+    const std::size_t total = static_cast<std::size_t>(col.offsets[col.rows] - col.offsets[0]);
+    const class_set* cached = detail::class_set_for(detail::bind_mask(mask), total);
+    const class_set set = cached != nullptr ? *cached : class_set(mask);
+    // Room for the untrimmed data, so the appends never reallocate.
+    out_data.reserve(total);
+    for (std::size_t i = 0; i < col.rows; ++i) {
+        out_data.append(trim(col[i], set));
+        out_offsets[i + 1] = static_cast<Offset>(out_data.size());
+    }
+}
+
+// Sets bit i when every byte of row i is in mask (empty rows included).
+template <class Offset>
+inline void all_of_class_column(const basic_string_column<Offset>& col, char_class mask,
+                                std::uint8_t* bits) noexcept {
+    if (col.rows == 0) return;
+    std::memset(bits, 0xff, (col.rows + 7) / 8);
+    if (col.rows % 8 != 0)  // padding bits past the last row stay clear
+        bits[col.rows / 8] = static_cast<std::uint8_t>((1u << (col.rows % 8)) - 1);
+    detail::rows_outside_class(col.data, col.offsets, col.rows, mask, [bits](std::size_t i) {
+        bits[i / 8] &= static_cast<std::uint8_t>(~(1u << (i % 8)));
+    });
+}
+
+// Sets bit i when row i equals value ignoring case, as iequals does.
+template <class Offset>
+inline void iequals_column(const basic_string_column<Offset>& col, std::string_view value,
+                           std::uint8_t* bits) noexcept {
+    detail::fill_bits(bits, col.rows, [&col, value](std::size_t i) { return iequals(col[i], value); });
+}
+
+// Dictionary-encoded forms: row i is dictionary[indices[i]].
+template <class Offset, class Index>
+inline void all_of_class_column(const basic_string_column<Offset>& dictionary,
+                                const Index* indices, std::size_t rows, char_class mask,
+                                std::uint8_t* bits) {
+    std::vector<std::uint8_t> entries((dictionary.rows + 7) / 8);
+    all_of_class_column(dictionary, mask, entries.data());
+    detail::fill_bits(bits, rows, [&](std::size_t i) {
+        return detail::test_bit(entries.data(), static_cast<std::size_t>(indices[i]));
+    });
+}
+template <class Offset, class Index>
+inline void iequals_column(const basic_string_column<Offset>& dictionary, const Index* indices,
+                           std::size_t rows, std::string_view value, std::uint8_t* bits) {
+    std::vector<std::uint8_t> entries((dictionary.rows + 7) / 8);
+    iequals_column(dictionary, value, entries.data());
+    detail::fill_bits(bits, rows, [&](std::size_t i) {
+        return detail::test_bit(entries.data(), static_cast<std::size_t>(indices[i]));
+    });
+}
+
+// ------------------------------
+// Scatter-gather buffers
+// ------------------------------
+// Overloads over a chain of buffers as filled by readv / recvmsg: any
+// array of structs with iov_base and iov_len members, such as struct
+// iovec, so no copy into one string is needed. Positions are offsets into
+// the logical concatenation of the segments. Each segment goes through the
+// kernels directly; ifind also finds matches that cross segment
+// boundaries.
+namespace detail {
+template <class T, class = void>
+inline constexpr bool is_iovec = false;
+template <class T>
+inline constexpr bool is_iovec<T, std::void_t<decltype(std::declval<const T&>().iov_base),
+                                              decltype(std::declval<const T&>().iov_len)>> = true;
+
+template <class Iovec>
+[[nodiscard]] inline std::string_view segment(const Iovec& v) noexcept {
+    return {static_cast<const char*>(v.iov_base), static_cast<std::size_t>(v.iov_len)};
+}
+
+template <class Iovec>
+[[nodiscard]] inline std::size_t total_size(const Iovec* iov, std::size_t count) noexcept {
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < count; ++i) n += static_cast<std::size_t>(iov[i].iov_len);
+    return n;
+}
+
+template <class Iovec>
+inline std::size_t find_class(const Iovec* iov, std::size_t count, char_class mask,
+                              std::size_t pos, bool first, bool member) noexcept {
+    const std::size_t total = total_size(iov, count);
+    if (total == 0) return std::string_view::npos;
+    const class_set* cached = class_set_for(bind_mask(mask), total);
+    const class_set set = cached != nullptr ? *cached : class_set(mask);
+    if (first) {
+        for (std::size_t i = 0, base = 0; i < count; ++i) {
+            const std::string_view sv = segment(iov[i]);
+            if (pos < base + sv.size()) {
+                const std::size_t hit = find_class(sv, set, pos > base ? pos - base : 0, true, member);
+                if (hit != std::string_view::npos) return base + hit;
+            }
+            base += sv.size();
+        }
+    } else {
+        for (std::size_t i = count, end = total; i-- > 0;) {
+            const std::string_view sv = segment(iov[i]);
+            const std::size_t base = end - sv.size();
+            if (!sv.empty() && pos >= base) {
+                const std::size_t hit = find_class(sv, set, pos - base, false, member);
+                if (hit != std::string_view::npos) return base + hit;
+            }
+            end = base;
+        }
+    }
+    return std::string_view::npos;
+}
+} // namespace detail
+
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+inline void to_upper_inplace(const Iovec* iov, std::size_t count, const locale_snapshot& loc) noexcept {
+    for (std::size_t i = 0; i < count; ++i)
+        detail::convert_case<true>(static_cast<char*>(iov[i].iov_base),
+                                   static_cast<std::size_t>(iov[i].iov_len), loc, nullptr);
+}
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+inline void to_lower_inplace(const Iovec* iov, std::size_t count, const locale_snapshot& loc) noexcept {
+    for (std::size_t i = 0; i < count; ++i)
+        detail::convert_case<false>(static_cast<char*>(iov[i].iov_base),
+                                    static_cast<std::size_t>(iov[i].iov_len), loc, nullptr);
+}
+// All segments go through the same tables, even if refresh_locale runs
+// meanwhile.
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+inline void to_upper_inplace(const Iovec* iov, std::size_t count) noexcept {
+    if (const auto* loc = detail::published_locale()) return to_upper_inplace(iov, count, *loc);
+    for (std::size_t i = 0; i < count; ++i)
+        detail::convert_case<true>(static_cast<char*>(iov[i].iov_base),
+                                   static_cast<std::size_t>(iov[i].iov_len), nullptr);
+}
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+inline void to_lower_inplace(const Iovec* iov, std::size_t count) noexcept {
+    if (const auto* loc = detail::published_locale()) return to_lower_inplace(iov, count, *loc);
+    for (std::size_t i = 0; i < count; ++i)
+        detail::convert_case<false>(static_cast<char*>(iov[i].iov_base),
+                                    static_cast<std::size_t>(iov[i].iov_len), nullptr);
+}
+
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+[[nodiscard]] inline std::size_t find_first_of_class(const Iovec* iov, std::size_t count,
+                                                     char_class mask, std::size_t pos = 0) noexcept {
+    return detail::find_class(iov, count, mask, pos, true, true);
+}
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+[[nodiscard]] inline std::size_t find_first_not_of_class(const Iovec* iov, std::size_t count,
+                                                         char_class mask, std::size_t pos = 0) noexcept {
+    return detail::find_class(iov, count, mask, pos, true, false);
+}
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+[[nodiscard]] inline std::size_t find_last_of_class(const Iovec* iov, std::size_t count,
+                                                    char_class mask,
+                                                    std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(iov, count, mask, pos, false, true);
+}
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+[[nodiscard]] inline std::size_t find_last_not_of_class(const Iovec* iov, std::size_t count,
+                                                        char_class mask,
+                                                        std::size_t pos = std::string_view::npos) noexcept {
+    return detail::find_class(iov, count, mask, pos, false, false);
+}
+
+// First case-insensitive match of needle at or after pos. Each segment is
+// searched with the kernels; at every boundary the last needle.size() - 1
+// bytes before it (which may come from several short segments) and the
+// first ones after it are searched together for a match that crosses it.
+// Needles over 65 bytes need a heap buffer for that window.
+template <class Iovec, std::enable_if_t<detail::is_iovec<Iovec>, int> = 0>
+[[nodiscard]] inline std::size_t ifind(const Iovec* iov, std::size_t count, std::string_view needle,
+                                       std::size_t pos = 0) {
+    const std::size_t total = detail::total_size(iov, count);
+    const std::size_t m = needle.size();
+    if (pos > total || m > total - pos) return std::string_view::npos;
+    if (m == 0) return pos;
+
+    char local[128];
+    std::string heap;
+    char* window = local;
+    if (2 * (m - 1) > sizeof local) {
+        heap.resize(2 * (m - 1));
+        window = heap.data();
+    }
+    std::size_t carry = 0;  // bytes before the current segment, at window[0, carry)
+    for (std::size_t i = 0, base = 0; i < count; ++i) {
+        std::string_view sv = detail::segment(iov[i]);
+        const std::size_t seg_base = base;
+        base += sv.size();
+        if (base <= pos) continue;
+        if (pos > seg_base) sv.remove_prefix(pos - seg_base);
+        const std::size_t start = base - sv.size();  // logical position of sv[0]
+        const std::size_t head = std::min(m - 1, sv.size());
+        std::memcpy(window + carry, sv.data(), head);
+        if (carry > 0) {
+            const std::size_t j = ifind(std::string_view(window, carry + head), needle);
+            if (j < carry) return start - carry + j;
+        }
+        const std::size_t j = ifind(sv, needle);
+        if (j != std::string_view::npos) return start + j;
+        // Keep the last m - 1 bytes seen for the next boundary.
+        if (sv.size() >= m - 1) {
+            carry = m - 1;
+            std::memcpy(window, sv.data() + sv.size() - carry, carry);
+        } else {
+            const std::size_t seen = carry + head;  // head is all of sv here
+            const std::size_t kept = std::min(m - 1, seen);
+            std::memmove(window, window + seen - kept, kept);
+            carry = kept;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// ------------------------------
+// Policy front end
+// ------------------------------
+// basic_cctype<Policy> offers the whole API (classifiers, transforms,
+// functors, bulk routines) with the semantics fixed at compile time, so a
+// hot module can pick the cheapest one that is correct for its data:
+//
+//   policy::ascii               'a'..'z' / 'A'..'Z' and the "C" classes,
+//                               by arithmetic; constexpr
+//   policy::c_locale_constexpr  the same mapping from 256-entry constexpr
+//                               tables of the "C" locale; constexpr
+//   policy::snapshot            the tables of a locale_snapshot
+//   policy::runtime_locale      today's behaviour: the published tables,
+//                               else the current C locale
+//
+// The first two agree on every byte and never read the locale; they differ
+// only in code shape (compares vs one table load). cctype is the
+// runtime_locale instance, i.e. the free functions above.
+//
+// A policy provides to_upper, to_lower and classes (the char_class bits of
+// a byte) plus five bulk hooks: convert_case<Upper>(src, dst, n),
+// find_class(sv, mask, pos, first, member), imismatch(a, b, n),
+// ifind(hay, needle, from, last, reverse) and ihash(s). The
+// case-insensitive hooks fold with the policy's to_lower.
+namespace detail {
+// char_class bits of byte u in the "C" locale.
+[[nodiscard]] constexpr std::uint16_t c_locale_classes(unsigned u) noexcept {
+    using bits = std::uint16_t;
+    const char ch = static_cast<char>(u);
+    const auto bit = [](bool on, char_class c) { return on ? static_cast<bits>(c) : bits{0}; };
+    return static_cast<bits>(
+        bit(ascii_is_upper(ch), char_class::upper) | bit(ascii_is_lower(ch), char_class::lower) |
+        bit(ascii_is_alpha(ch), char_class::alpha) | bit(ascii_is_digit(ch), char_class::digit) |
+        bit(ascii_is_xdigit(ch), char_class::xdigit) | bit(ascii_is_space(ch), char_class::space) |
+        bit(ascii_is_print(ch), char_class::print) | bit(ascii_is_graph(ch), char_class::graph) |
+        bit(ascii_is_blank(ch), char_class::blank) | bit(ascii_is_cntrl(ch), char_class::cntrl) |
+        bit(ascii_is_punct(ch), char_class::punct) | bit(ascii_is_alnum(ch), char_class::alnum));
+}
+
+struct c_locale_tables {
+    std::uint16_t classes[256];
+    unsigned char upper[256];
+    unsigned char lower[256];
+};
+
+constexpr c_locale_tables make_c_locale_tables() noexcept {
+    c_locale_tables t{};
+    for (unsigned u = 0; u < 256; ++u) {
+        t.classes[u] = c_locale_classes(u);
+        t.upper[u] = static_cast<unsigned char>(ascii_to_upper(static_cast<char>(u)));
+        t.lower[u] = static_cast<unsigned char>(ascii_to_lower(static_cast<char>(u)));
+    }
+    return t;
+}
+inline constexpr c_locale_tables c_locale_table = make_c_locale_tables();
+
+// From this length on, building a class_set and scanning with the kernels
+// beats testing each byte; below it the loop is cheaper than the set.
+inline constexpr std::size_t class_set_min = 256;
+
+// Bulk hooks shared by policies whose case mapping is ASCII for every byte.
+template <class Derived>
+struct ascii_case_bulk {
+    template <bool Upper>
+    static void convert_case(const char* src, char* dst, std::size_t n) noexcept {
+        detail::convert_case<Upper>(src, dst, n, ascii_fit::all,
+                                    [](char c) { return Upper ? ascii_to_upper(c) : ascii_to_lower(c); },
+                                    nullptr);
+    }
+    static std::size_t find_class(std::string_view sv, char_class mask, std::size_t pos, bool first,
+                                  bool member) noexcept {
+        const auto m = static_cast<std::uint16_t>(mask);
+        const auto in_class = [m](char ch) { return (Derived::classes(ch) & m) != 0; };
+        if (sv.size() < class_set_min) return find_class_if(sv, pos, first, member, in_class);
+        class_set set;
+        for (int c = 0; c < 256; ++c)
+            if (in_class(static_cast<char>(c))) set.insert(static_cast<char>(c));
+        return detail::find_class(sv, set, pos, first, member);
+    }
+    static std::size_t imismatch(const char* a, const char* b, std::size_t n) noexcept {
+        return detail::imismatch(a, b, n, ascii_fit::all, ascii_to_lower);
+    }
+    static std::size_t ifind(std::string_view hay, std::string_view needle, std::size_t from,
+                             std::size_t last, bool reverse) noexcept {
+        return detail::ifind_range(hay, needle, from, last, reverse, ascii_fit::all, ascii_to_lower);
+    }
+    static std::uint64_t ihash(std::string_view s) noexcept {
+        return detail::ihash(s, ascii_fit::all, ascii_to_lower);
+    }
+};
+} // namespace detail
+
+namespace policy {
+struct ascii : detail::ascii_case_bulk<ascii> {
+    [[nodiscard]] static constexpr char to_upper(char ch) noexcept { return ascii_to_upper(ch); }
+    [[nodiscard]] static constexpr char to_lower(char ch) noexcept { return ascii_to_lower(ch); }
+    [[nodiscard]] static constexpr std::uint16_t classes(char ch) noexcept {
+        return detail::c_locale_classes(static_cast<unsigned char>(ch));
+    }
+};
+
+struct c_locale_constexpr : detail::ascii_case_bulk<c_locale_constexpr> {
+    [[nodiscard]] static constexpr char to_upper(char ch) noexcept {
+        return static_cast<char>(detail::c_locale_table.upper[static_cast<unsigned char>(ch)]);
+    }
+    [[nodiscard]] static constexpr char to_lower(char ch) noexcept {
+        return static_cast<char>(detail::c_locale_table.lower[static_cast<unsigned char>(ch)]);
+    }
+    [[nodiscard]] static constexpr std::uint16_t classes(char ch) noexcept {
+        return detail::c_locale_table.classes[static_cast<unsigned char>(ch)];
+    }
+};
+
+// Refers to a snapshot, which must outlive every use of the policy.
+class snapshot {
+public:
+    explicit snapshot(const locale_snapshot& loc) noexcept : loc_(&loc) {}
+
+    [[nodiscard]] char to_upper(char ch) const noexcept { return loc_->to_upper(ch); }
+    [[nodiscard]] char to_lower(char ch) const noexcept { return loc_->to_lower(ch); }
+    [[nodiscard]] std::uint16_t classes(char ch) const noexcept { return loc_->classes(ch); }
+
+    template <bool Upper>
+    void convert_case(const char* src, char* dst, std::size_t n) const noexcept {
+        detail::convert_case<Upper>(src, dst, n, *loc_, nullptr);
+    }
+    std::size_t find_class(std::string_view sv, char_class mask, std::size_t pos, bool first,
+                           bool member) const noexcept {
+        if (sv.size() < detail::class_set_min)
+            return detail::find_class_if(sv, pos, first, member,
+                                         [this, mask](char ch) { return loc_->is(ch, mask); });
+        return detail::find_class(sv, class_set(mask, *loc_), pos, first, member);
+    }
+    std::size_t imismatch(const char* a, const char* b, std::size_t n) const noexcept {
+        const locale_snapshot& loc = *loc_;
+        return detail::imismatch(a, b, n, loc.case_fit(), [&loc](char c) { return loc.to_lower(c); });
+    }
+    std::size_t ifind(std::string_view hay, std::string_view needle, std::size_t from, std::size_t last,
+                      bool reverse) const noexcept {
+        const locale_snapshot& loc = *loc_;
+        return detail::ifind_range(hay, needle, from, last, reverse, loc.case_fit(),
+                                   [&loc](char c) { return loc.to_lower(c); });
+    }
+    std::uint64_t ihash(std::string_view s) const noexcept {
+        const locale_snapshot& loc = *loc_;
+        return detail::ihash(s, loc.case_fit(), [&loc](char c) { return loc.to_lower(c); });
+    }
+
+private:
+    const locale_snapshot* loc_;
+};
+
+struct runtime_locale {
+    [[nodiscard]] static char to_upper(char ch) noexcept { return safe::to_upper(ch); }
+    [[nodiscard]] static char to_lower(char ch) noexcept { return safe::to_lower(ch); }
+    [[nodiscard]] static std::uint16_t classes(char ch) noexcept {
+        return static_cast<std::uint16_t>(detail::class_bits(ch, detail::all_classes) &
+                                          static_cast<std::uint16_t>(detail::all_classes));
+    }
+
+    template <bool Upper>
+    static void convert_case(const char* src, char* dst, std::size_t n) noexcept {
+        detail::convert_case<Upper>(src, dst, n, nullptr);
+    }
+    static std::size_t find_class(std::string_view sv, char_class mask, std::size_t pos, bool first,
+                                  bool member) noexcept {
+        return detail::find_class(sv, mask, pos, first, member);
+    }
+    static std::size_t imismatch(const char* a, const char* b, std::size_t n) noexcept {
+        return detail::imismatch(a, b, n);
+    }
+    static std::size_t ifind(std::string_view hay, std::string_view needle, std::size_t from,
+                             std::size_t last, bool reverse) noexcept {
+        return detail::ifind_range(hay, needle, from, last, reverse);
+    }
+    static std::uint64_t ihash(std::string_view s) noexcept { return safe::ihash(s); }
+};
+} // namespace policy
+
+template <class Policy>
+class basic_cctype {
+public:
+    using policy_type = Policy;
+
+    constexpr basic_cctype() noexcept = default;
+    constexpr explicit basic_cctype(const Policy& policy) noexcept : policy_(policy) {}
+
+    [[nodiscard]] constexpr const Policy& policy() const noexcept { return policy_; }
+
+    // Single characters
+    [[nodiscard]] constexpr char to_upper(char ch) const noexcept { return policy_.to_upper(ch); }
+    [[nodiscard]] constexpr char to_lower(char ch) const noexcept { return policy_.to_lower(ch); }
+
+    [[nodiscard]] constexpr std::uint16_t classes(char ch) const noexcept { return policy_.classes(ch); }
+    [[nodiscard]] constexpr bool is_any(char ch, char_class mask) const noexcept {
+        return (classes(ch) & static_cast<std::uint16_t>(mask)) != 0;
+    }
+    [[nodiscard]] constexpr bool is_all(char ch, char_class mask) const noexcept {
+        const auto m = static_cast<std::uint16_t>(mask);
+        return (classes(ch) & m) == m;
+    }
+    [[nodiscard]] constexpr bool is_alpha(char ch) const noexcept { return is_any(ch, char_class::alpha); }
+    [[nodiscard]] constexpr bool is_digit(char ch) const noexcept { return is_any(ch, char_class::digit); }
+    [[nodiscard]] constexpr bool is_alnum(char ch) const noexcept { return is_any(ch, char_class::alnum); }
+    [[nodiscard]] constexpr bool is_space(char ch) const noexcept { return is_any(ch, char_class::space); }
+    [[nodiscard]] constexpr bool is_cntrl(char ch) const noexcept { return is_any(ch, char_class::cntrl); }
+    [[nodiscard]] constexpr bool is_punct(char ch) const noexcept { return is_any(ch, char_class::punct); }
+    [[nodiscard]] constexpr bool is_print(char ch) const noexcept { return is_any(ch, char_class::print); }
+    [[nodiscard]] constexpr bool is_graph(char ch) const noexcept { return is_any(ch, char_class::graph); }
+    [[nodiscard]] constexpr bool is_xdigit(char ch) const noexcept { return is_any(ch, char_class::xdigit); }
+    [[nodiscard]] constexpr bool is_upper(char ch) const noexcept { return is_any(ch, char_class::upper); }
+    [[nodiscard]] constexpr bool is_lower(char ch) const noexcept { return is_any(ch, char_class::lower); }
+    [[nodiscard]] constexpr bool is_blank(char ch) const noexcept { return is_any(ch, char_class::blank); }
+
+    // Functors for the standard algorithms
+    struct ToUpper {
+        Policy policy{};
+        [[nodiscard]] constexpr char operator()(unsigned char c) const noexcept {
+            return policy.to_upper(static_cast<char>(c));
+        }
+    };
+    struct ToLower {
+        Policy policy{};
+        [[nodiscard]] constexpr char operator()(unsigned char c) const noexcept {
+            return policy.to_lower(static_cast<char>(c));
+        }
+    };
+    [[nodiscard]] constexpr ToUpper to_upper_fn() const noexcept { return ToUpper{policy_}; }
+    [[nodiscard]] constexpr ToLower to_lower_fn() const noexcept { return ToLower{policy_}; }
+
+    // Transforms
+    void to_upper_inplace(std::string& s) const noexcept {
+        policy_.template convert_case<true>(s.data(), s.data(), s.size());
+    }
+    void to_lower_inplace(std::string& s) const noexcept {
+        policy_.template convert_case<false>(s.data(), s.data(), s.size());
+    }
+    template <class It>
+    void to_upper_inplace(It first, It last) const {
+        if constexpr (detail::is_contiguous_char_iterator<It>) {
+            if (first != last) {
+                char* p = &*first;
+                policy_.template convert_case<true>(p, p, static_cast<std::size_t>(last - first));
+            }
+            return;
+        }
+        std::transform(first, last, first, to_upper_fn());
+    }
+    template <class It>
+    void to_lower_inplace(It first, It last) const {
+        if constexpr (detail::is_contiguous_char_iterator<It>) {
+            if (first != last) {
+                char* p = &*first;
+                policy_.template convert_case<false>(p, p, static_cast<std::size_t>(last - first));
+            }
+            return;
+        }
+        std::transform(first, last, first, to_lower_fn());
+    }
+    [[nodiscard]] std::string to_upper_copy(std::string_view sv) const {
+        std::string out;
+        detail::append_with(out, sv.size(), [&](char* p) {
+            policy_.template convert_case<true>(sv.data(), p, sv.size());
+        });
+        return out;
+    }
+    [[nodiscard]] std::string to_lower_copy(std::string_view sv) const {
+        std::string out;
+        detail::append_with(out, sv.size(), [&](char* p) {
+            policy_.template convert_case<false>(sv.data(), p, sv.size());
+        });
+        return out;
+    }
+
+    // Class scanners and trimming, as the free functions of the same name
+    [[nodiscard]] std::size_t find_first_of_class(std::string_view sv, char_class mask,
+                                                  std::size_t pos = 0) const noexcept {
+        return policy_.find_class(sv, mask, pos, true, true);
+    }
+    [[nodiscard]] std::size_t find_first_not_of_class(std::string_view sv, char_class mask,
+                                                      std::size_t pos = 0) const noexcept {
+        return policy_.find_class(sv, mask, pos, true, false);
+    }
+    [[nodiscard]] std::size_t find_last_of_class(std::string_view sv, char_class mask,
+                                                 std::size_t pos = std::string_view::npos) const noexcept {
+        return policy_.find_class(sv, mask, pos, false, true);
+    }
+    [[nodiscard]] std::size_t find_last_not_of_class(std::string_view sv, char_class mask,
+                                                     std::size_t pos = std::string_view::npos) const noexcept {
+        return policy_.find_class(sv, mask, pos, false, false);
+    }
+    [[nodiscard]] std::string_view trim_left(std::string_view sv,
+                                             char_class mask = char_class::space) const noexcept {
+        const std::size_t b = find_first_not_of_class(sv, mask);
+        return b == std::string_view::npos ? sv.substr(sv.size()) : sv.substr(b);
+    }
+    [[nodiscard]] std::string_view trim_right(std::string_view sv,
+                                              char_class mask = char_class::space) const noexcept {
+        const std::size_t last = find_last_not_of_class(sv, mask);
+        return sv.substr(0, last == std::string_view::npos ? 0 : last + 1);
+    }
+    [[nodiscard]] std::string_view trim(std::string_view sv,
+                                        char_class mask = char_class::space) const noexcept {
+        return trim_right(trim_left(sv, mask), mask);
+    }
+    void trim_inplace(std::string& s, char_class mask = char_class::space) const {
+        detail::keep_only(s, trim(s, mask));
+    }
+    void trim_left_inplace(std::string& s, char_class mask = char_class::space) const {
+        detail::keep_only(s, trim_left(s, mask));
+    }
+    void trim_right_inplace(std::string& s, char_class mask = char_class::space) const {
+        detail::keep_only(s, trim_right(s, mask));
+    }
+    [[nodiscard]] bool all_of_class(std::string_view sv, char_class mask) const noexcept {
+        return find_first_not_of_class(sv, mask) == std::string_view::npos;
+    }
+
+    // A class_set already fixes its bytes, so these are the same for every
+    // policy; build it with class_set(mask, loc) to follow a snapshot.
+    [[nodiscard]] std::size_t find_first_of_class(std::string_view sv, const class_set& set,
+                                                  std::size_t pos = 0) const noexcept {
+        return safe::find_first_of_class(sv, set, pos);
+    }
+    [[nodiscard]] std::size_t find_first_not_of_class(std::string_view sv, const class_set& set,
+                                                      std::size_t pos = 0) const noexcept {
+        return safe::find_first_not_of_class(sv, set, pos);
+    }
+    [[nodiscard]] std::size_t find_last_of_class(std::string_view sv, const class_set& set,
+                                                 std::size_t pos = std::string_view::npos) const noexcept {
+        return safe::find_last_of_class(sv, set, pos);
+    }
+    [[nodiscard]] std::size_t find_last_not_of_class(std::string_view sv, const class_set& set,
+                                                     std::size_t pos = std::string_view::npos) const noexcept {
+        return safe::find_last_not_of_class(sv, set, pos);
+    }
+    [[nodiscard]] std::string_view trim(std::string_view sv, const class_set& set) const noexcept {
+        return safe::trim(sv, set);
+    }
+    [[nodiscard]] std::string_view trim_left(std::string_view sv, const class_set& set) const noexcept {
+        return safe::trim_left(sv, set);
+    }
+    [[nodiscard]] std::string_view trim_right(std::string_view sv, const class_set& set) const noexcept {
+        return safe::trim_right(sv, set);
+    }
+    void trim_inplace(std::string& s, const class_set& set) const { safe::trim_inplace(s, set); }
+    void trim_left_inplace(std::string& s, const class_set& set) const { safe::trim_left_inplace(s, set); }
+    void trim_right_inplace(std::string& s, const class_set& set) const { safe::trim_right_inplace(s, set); }
+    [[nodiscard]] bool all_of_class(std::string_view sv, const class_set& set) const noexcept {
+        return safe::all_of_class(sv, set);
+    }
+
+    // Case-insensitive comparison, folding with to_lower
+    [[nodiscard]] bool iequals(std::string_view a, std::string_view b) const noexcept {
+        return a.size() == b.size() && policy_.imismatch(a.data(), b.data(), a.size()) == a.size();
+    }
+    [[nodiscard]] int icompare(std::string_view a, std::string_view b) const noexcept {
+        const std::size_t n = std::min(a.size(), b.size());
+        const std::size_t i = policy_.imismatch(a.data(), b.data(), n);
+        if (i < n) {
+            const auto x = static_cast<unsigned char>(to_lower(a[i]));
+            const auto y = static_cast<unsigned char>(to_lower(b[i]));
+            return x < y ? -1 : 1;
+        }
+        return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+    }
+    [[nodiscard]] std::size_t ifind(std::string_view hay, std::string_view needle,
+                                    std::size_t pos = 0) const noexcept {
+        if (pos > hay.size() || needle.size() > hay.size() - pos) return std::string_view::npos;
+        if (needle.empty()) return pos;
+        return policy_.ifind(hay, needle, pos, hay.size() - needle.size(), false);
+    }
+    [[nodiscard]] std::size_t irfind(std::string_view hay, std::string_view needle,
+                                     std::size_t pos = std::string_view::npos) const noexcept {
+        if (needle.size() > hay.size()) return std::string_view::npos;
+        const std::size_t last = std::min(pos, hay.size() - needle.size());
+        if (needle.empty()) return last;
+        return policy_.ifind(hay, needle, 0, last, true);
+    }
+    [[nodiscard]] bool istarts_with(std::string_view s, std::string_view prefix) const noexcept {
+        return s.size() >= prefix.size() && iequals(s.substr(0, prefix.size()), prefix);
+    }
+    [[nodiscard]] bool iends_with(std::string_view s, std::string_view suffix) const noexcept {
+        return s.size() >= suffix.size() && iequals(s.substr(s.size() - suffix.size()), suffix);
+    }
+    [[nodiscard]] bool icontains(std::string_view hay, std::string_view needle) const noexcept {
+        return ifind(hay, needle) != std::string_view::npos;
+    }
+
+    // Case-insensitive hashing; equal under iequals means equal hash
+    [[nodiscard]] std::uint64_t ihash(std::string_view s) const noexcept { return policy_.ihash(s); }
+    struct ci_hash {
+        using is_transparent = void;
+        Policy policy{};
+        [[nodiscard]] std::size_t operator()(std::string_view s) const noexcept {
+            return static_cast<std::size_t>(policy.ihash(s));
+        }
+    };
+    struct ci_equal {
+        using is_transparent = void;
+        Policy policy{};
+        [[nodiscard]] bool operator()(std::string_view a, std::string_view b) const noexcept {
+            return basic_cctype(policy).iequals(a, b);
+        }
+    };
+    [[nodiscard]] constexpr ci_hash ci_hash_fn() const noexcept { return ci_hash{policy_}; }
+    [[nodiscard]] constexpr ci_equal ci_equal_fn() const noexcept { return ci_equal{policy_}; }
+
+    // The same for every policy: no byte below 0x80 is locale-dependent
+    [[nodiscard]] bool is_ascii(std::string_view sv) const noexcept { return safe::is_ascii(sv); }
+
+private:
+    Policy policy_{};
+};
+
+using cctype = basic_cctype<policy::runtime_locale>;
+using ascii_cctype = basic_cctype<policy::ascii>;
+using c_locale_cctype = basic_cctype<policy::c_locale_constexpr>;
+using snapshot_cctype = basic_cctype<policy::snapshot>;
+
+// Example:
+// constexpr ctz::safe::ascii_cctype ascii;
+// static_assert(ascii.to_upper('q') == 'Q' && ascii.is_xdigit('F'));
+// ctz::safe::snapshot_cctype loc_cc{ctz::safe::policy::snapshot(loc)};
+
+// ------------------------------
+// Range adaptors (C++20)
+// ------------------------------
+// views::upper, views::lower and views::filter_class(mask) compose with
+// std::views on either side and never allocate:
+//
+//   for (char c : s | std::views::drop(1) | ctz::safe::views::upper) ...
+//   auto first3 = ctz::safe::views::lower | std::views::take(3);
+//   std::string copy(sv | ctz::safe::views::upper);
+//
+// Over a contiguous char range, upper/lower yield a random-access view.
+// begin() picks the tables once and the iterator converts 64 bytes at a
+// time through the bulk kernels as it steps, so ranges::copy and range-for
+// never call <cctype> per byte. Converting the view to a std::string
+// (directly or via ranges::to) runs the kernels over the whole source in
+// one call. Other ranges fall back to std::views::transform with
+// ToUpper / ToLower.
+#if defined(__cpp_lib_ranges)
+namespace detail {
+template <class V>
+concept contiguous_chars =
+    std::ranges::contiguous_range<const V> &&
+    std::same_as<std::remove_cv_t<std::ranges::range_value_t<const V>>, char>;
+
+template <std::ranges::view V, bool Upper>
+    requires contiguous_chars<V>
+class case_view : public std::ranges::view_interface<case_view<V, Upper>> {
+public:
+    // Holds its 64-byte block of the source converted through convert_case,
+    // refilled whenever a move leaves it, and serves * from there. []
+    // maps the single byte through the same tables.
+    class iterator {
+    public:
+        using value_type = char;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag;  // yields prvalues
+
+        iterator() = default;
+        iterator(const char* first, const char* last, const char* pos,
+                 const locale_snapshot* loc) noexcept
+            : first_(first), last_(last), pos_(pos), loc_(loc) {
+            refill();
+        }
+
+        [[nodiscard]] char operator*() const noexcept { return buf_[pos_ - window_]; }
+        [[nodiscard]] char operator[](difference_type n) const noexcept { return convert(pos_[n]); }
+
+        iterator& operator++() noexcept {
+            if (++pos_ == window_end_) refill();
+            return *this;
+        }
+        iterator operator++(int) noexcept { iterator old = *this; ++*this; return old; }
+        iterator& operator--() noexcept {
+            if (pos_-- == window_) refill();
+            return *this;
+        }
+        iterator operator--(int) noexcept { iterator old = *this; --*this; return old; }
+        iterator& operator+=(difference_type n) noexcept {
+            pos_ += n;
+            if (pos_ < window_ || pos_ >= window_end_) refill();
+            return *this;
+        }
+        iterator& operator-=(difference_type n) noexcept { return *this += -n; }
+
+        [[nodiscard]] friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+        [[nodiscard]] friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+        [[nodiscard]] friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+        [[nodiscard]] friend difference_type operator-(const iterator& a, const iterator& b) noexcept {
+            return a.pos_ - b.pos_;
+        }
+        [[nodiscard]] friend bool operator==(const iterator& a, const iterator& b) noexcept {
+            return a.pos_ == b.pos_;
+        }
+        [[nodiscard]] friend auto operator<=>(const iterator& a, const iterator& b) noexcept {
+            return a.pos_ <=> b.pos_;
+        }
+
+    private:
+        static constexpr std::size_t window_size = 64;
+
+        // Null loc_ means the mapping is the ASCII one.
+        [[nodiscard]] char convert(char ch) const noexcept {
+            if (loc_ != nullptr) return Upper ? loc_->to_upper(ch) : loc_->to_lower(ch);
+            return Upper ? ascii_to_upper(ch) : ascii_to_lower(ch);
+        }
+
+        // Converts the block holding pos_; at last_ the window is empty.
+        void refill() noexcept {
+            if (pos_ == last_) {
+                window_ = window_end_ = last_;
+                return;
+            }
+            window_ = first_ + std::size_t(pos_ - first_) / window_size * window_size;
+            const std::size_t n = std::min(window_size, std::size_t(last_ - window_));
+            window_end_ = window_ + n;
+            if (loc_ != nullptr)
+                convert_case<Upper>(window_, buf_, n, *loc_, nullptr);
+            else if (n <= short_input_max)
+                ascii_case_swar<Upper>(window_, buf_, n);
+            else
+                (Upper ? kernels().to_upper : kernels().to_lower)(window_, buf_, n);
+        }
+
+        const char* first_ = nullptr;
+        const char* last_ = nullptr;
+        const char* pos_ = nullptr;
+        const locale_snapshot* loc_ = nullptr;
+        const char* window_ = nullptr;      // source of buf_[0]
+        const char* window_end_ = nullptr;  // one past the converted source
+        char buf_[window_size] = {};
+    };
+
+    case_view() requires std::default_initializable<V> = default;
+    constexpr explicit case_view(V base) : base_(std::move(base)) {}
+
+    [[nodiscard]] constexpr V base() const& requires std::copy_constructible<V> { return base_; }
+    [[nodiscard]] constexpr V base() && { return std::move(base_); }
+
+    [[nodiscard]] iterator begin() const {
+        const char* first = std::ranges::data(base_);
+        return iterator(first, first + size(), first, tables());
+    }
+    // Carries the tables too, so stepping back from end() converts alike.
+    [[nodiscard]] iterator end() const {
+        const char* first = std::ranges::data(base_);
+        return iterator(first, first + size(), first + size(), tables());
+    }
+    [[nodiscard]] constexpr auto size() const { return std::ranges::size(base_); }
+
+    // Bulk path: the whole source through convert_case in one call.
+    template <class Traits, class Alloc>
+    [[nodiscard]] explicit operator std::basic_string<char, Traits, Alloc>() const {
+        std::basic_string<char, Traits, Alloc> out;
+        append_case<Upper>(out, std::string_view(std::ranges::data(base_), std::ranges::size(base_)),
+                           published_locale());
+        return out;
+    }
+
+private:
+    // The published tables, none when the C library maps like ASCII, else
+    // an interned snapshot of its current locale.
+    [[nodiscard]] const locale_snapshot* tables() const {
+        if (const auto* loc = published_locale()) return loc;
+        return ctype_ascii_fit(size()) == ascii_fit::all ? nullptr : ctype_snapshot();
+    }
+
+    V base_ = V();
+};
+
+// Base of the closures below. Closures compose with each other and with
+// the std::views closures on either side of |; applying one to a range
+// calls it.
+struct adaptor_closure {};
+
+template <class C>
+concept own_closure = std::derived_from<std::remove_cvref_t<C>, adaptor_closure>;
+
+template <class Left, class Right>
+struct closure_pipe : adaptor_closure {
+    Left left;
+    Right right;
+    template <std::ranges::viewable_range R>
+    [[nodiscard]] constexpr auto operator()(R&& r) const {
+        return right(left(std::forward<R>(r)));
+    }
+};
+
+template <std::ranges::viewable_range R, own_closure C>
+[[nodiscard]] constexpr auto operator|(R&& r, C&& closure) {
+    return std::forward<C>(closure)(std::forward<R>(r));
+}
+template <class Left, class Right>
+    requires(!std::ranges::range<Left> && (own_closure<Left> || own_closure<Right>))
+[[nodiscard]] constexpr auto operator|(Left&& left, Right&& right) {
+    return closure_pipe<std::remove_cvref_t<Left>, std::remove_cvref_t<Right>>{
+        {}, std::forward<Left>(left), std::forward<Right>(right)};
+}
+
+template <bool Upper>
+struct case_adaptor : adaptor_closure {
+    template <std::ranges::viewable_range R>
+    [[nodiscard]] constexpr auto operator()(R&& r) const {
+        using V = std::views::all_t<R>;
+        if constexpr (contiguous_chars<V>)
+            return case_view<V, Upper>(std::views::all(std::forward<R>(r)));
+        else
+            return std::views::transform(std::forward<R>(r),
+                                         std::conditional_t<Upper, ToUpper, ToLower>{});
+    }
+};
+
+struct class_predicate {
+    char_class mask;
+    [[nodiscard]] bool operator()(char ch) const noexcept { return is_any(ch, mask); }
+};
+
+struct filter_class_closure : adaptor_closure {
+    char_class mask;
+    template <std::ranges::viewable_range R>
+    [[nodiscard]] constexpr auto operator()(R&& r) const {
+        return std::views::filter(std::forward<R>(r), class_predicate{mask});
+    }
+};
+
+struct filter_class_adaptor {
+    [[nodiscard]] constexpr filter_class_closure operator()(char_class mask) const noexcept {
+        return {{}, mask};
+    }
+    template <std::ranges::viewable_range R>
+    [[nodiscard]] constexpr auto operator()(R&& r, char_class mask) const {
+        return filter_class_closure{{}, mask}(std::forward<R>(r));
+    }
+};
+} // namespace detail
+
+namespace views {
+inline constexpr detail::case_adaptor<true> upper{};
+inline constexpr detail::case_adaptor<false> lower{};
+// Keeps the bytes that belong to at least one class in mask.
+inline constexpr detail::filter_class_adaptor filter_class{};
+} // namespace views
+#endif
+
 } // namespace ctz::safe
 
 // ------------------------------
@@ -149,7 +3426,15 @@ struct ToLower {
 // using ctz::safe::to_upper;          // single-char
 // using ctz::safe::to_upper_inplace;  // string & iterators
 // using ctz::safe::to_upper_copy;     // returns std::string
+// using ctz::safe::to_upper_into;     // appends to a string / fills a span
+// using ctz::safe::to_lower_batch;    // many short strings into one buffer
+// using ctz::safe::to_upper_column;   // Arrow-layout (data, offsets) columns
+// ctz::safe::to_lower_inplace(iov, iovcnt); // readv/recvmsg buffers, no copy
 // bool a = ctz::safe::is_alpha(ch);   // classification
+// ctz::safe::locale_snapshot loc;     // capture the locale once...
+// bool b = ctz::safe::is_alpha(ch, loc); // ...then one table load per call
+// constexpr ctz::safe::ascii_cctype cc; // semantics fixed at compile time
+// for (char c : s | ctz::safe::views::upper) { ... } // C++20, no allocation
 //
 // NOTE: Behavior follows current C locale (std::setlocale). If you need
 // Unicode case mapping and classification, use ICU, Boost.Text, or C++23
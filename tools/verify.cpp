@@ -0,0 +1,958 @@
+// Differential verifier: checks every accelerated path in safe_cctype.hpp
+// against the plain <cctype> reference, byte for byte.
+//
+//   c++ -std=c++20 -O2 -pthread -I.. verify.cpp -o verify
+//   ./verify [locale]...
+//
+// or `make check` in this directory. Build as C++20: under C++17 the span,
+// ranges and view checks are compiled out.
+//
+// Without arguments every locale listed by `locale -a` is checked (on
+// systems without it, just "C"). For each locale it compares
+//  - all 256 byte values through the single-char wrappers, the classifiers,
+//    is_any, locale_snapshot and the published tables;
+//  - every kernel the CPU supports (not only the dispatched one) over every
+//    alignment 0..63 and every length 0..300, on all-bytes, random and
+//    ASCII-letter inputs;
+//  - the public string APIs, with and without published tables, and the
+//    iterator overloads over contiguous and non-contiguous containers;
+//  - that the allocator and pmr overloads never call the global operator
+//    new, which this file replaces with a counting one;
+//  - the basic_cctype policies (ascii and c_locale_constexpr in "C"), per
+//    byte and through their bulk members;
+//  - with C++20, the views in both published and <cctype> modes;
+//  - 32 threads on the runtime API while another flips between "C" and
+//    the first checked locale whose case mapping is not ASCII. Build with
+//    -fsanitize=thread to also check the publication path for races.
+// The exit status is non-zero on any difference, so a build or CI step can
+// run it as a gate.
+
+#include "safe_cctype.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <clocale>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <memory_resource>
+#include <random>
+#if __has_include(<ranges>)
+#include <ranges>
+#endif
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// ------------------------------
+// Allocation counting
+// ------------------------------
+// Every global operator new is counted, so a check can assert that an
+// overload given an allocator never reaches the global heap. The array
+// and nothrow forms forward here by default.
+namespace {
+std::atomic<long> global_allocations{0};
+} // namespace
+
+void* operator new(std::size_t n) {
+    global_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n == 0 ? 1 : n)) return p;
+    throw std::bad_alloc();
+}
+// Kept out of line: inlined into a caller, GCC's -Wmismatched-new-delete
+// sees free() on a pointer from operator new.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+
+namespace {
+
+namespace cs = ctz::safe;
+namespace detail = ctz::safe::detail;
+using cs::char_class;
+
+constexpr std::size_t max_len = 300;
+constexpr std::size_t max_align = 64;
+constexpr long max_reports = 20;
+
+// ------------------------------
+// Failure reporting
+// ------------------------------
+struct report {
+    std::string locale;
+    long failures = 0;
+    long checks = 0;
+
+    template <class... Args>
+    void fail(const char* fmt, Args... args) {
+        if (++failures <= max_reports) {
+            std::printf("FAIL [%s] ", locale.c_str());
+            std::printf(fmt, args...);
+            std::printf("\n");
+        }
+    }
+    void expect(bool ok, const char* what, std::size_t n = 0, std::size_t align = 0) {
+        ++checks;
+        if (!ok) fail("%s (n=%zu, align=%zu)", what, n, align);
+    }
+    void expect_byte(bool ok, const char* what, int byte) {
+        ++checks;
+        if (!ok) fail("%s (byte 0x%02x)", what, byte);
+    }
+};
+
+// ------------------------------
+// Reference implementations
+// ------------------------------
+char ref_upper(char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); }
+char ref_lower(char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
+char ref_ascii_lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + 32) : c; }
+char ref_ascii_upper(char c) { return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 32) : c; }
+
+struct class_ref {
+    char_class cls;
+    const char* name;
+    int (*pred)(int);
+    bool (*wrapper)(char);
+};
+
+const class_ref classes[] = {
+    {char_class::upper, "upper", [](int c) { return std::isupper(c); }, nullptr},
+    {char_class::lower, "lower", [](int c) { return std::islower(c); }, nullptr},
+    {char_class::alpha, "alpha", [](int c) { return std::isalpha(c); }, cs::is_alpha},
+    {char_class::digit, "digit", [](int c) { return std::isdigit(c); }, cs::is_digit},
+    {char_class::xdigit, "xdigit", [](int c) { return std::isxdigit(c); }, cs::is_xdigit},
+    {char_class::space, "space", [](int c) { return std::isspace(c); }, cs::is_space},
+    {char_class::print, "print", [](int c) { return std::isprint(c); }, cs::is_print},
+    {char_class::graph, "graph", [](int c) { return std::isgraph(c); }, cs::is_graph},
+    {char_class::blank, "blank", [](int c) { return std::isblank(c); }, nullptr},
+    {char_class::cntrl, "cntrl", [](int c) { return std::iscntrl(c); }, cs::is_cntrl},
+    {char_class::punct, "punct", [](int c) { return std::ispunct(c); }, cs::is_punct},
+    {char_class::alnum, "alnum", [](int c) { return std::isalnum(c); }, cs::is_alnum},
+};
+
+bool ref_is_any(char ch, char_class mask) {
+    for (const class_ref& k : classes)
+        if ((mask & k.cls) != char_class::none && k.pred(static_cast<unsigned char>(ch)) != 0)
+            return true;
+    return false;
+}
+
+template <class Fold>
+std::size_t ref_find(std::string_view h, std::string_view needle, bool reverse, Fold fold) {
+    if (needle.size() > h.size()) return std::string_view::npos;
+    const std::size_t last = h.size() - needle.size();
+    for (std::size_t k = 0; k <= last; ++k) {
+        const std::size_t i = reverse ? last - k : k;
+        bool match = true;
+        for (std::size_t j = 0; j < needle.size() && match; ++j)
+            match = fold(h[i + j]) == fold(needle[j]);
+        if (match) return i;
+    }
+    return std::string_view::npos;
+}
+
+// ------------------------------
+// Inputs
+// ------------------------------
+enum class pattern { all_bytes, random, letters };
+const pattern patterns[] = {pattern::all_bytes, pattern::random, pattern::letters};
+
+void fill(char* p, std::size_t n, pattern kind, std::mt19937& rng) {
+    static const char letters[] = "abcxyzABCXYZ@[`{iI ";
+    for (std::size_t i = 0; i < n; ++i) {
+        switch (kind) {
+        case pattern::all_bytes: p[i] = static_cast<char>((i * 37 + n) & 0xff); break;
+        case pattern::random:    p[i] = static_cast<char>(rng()); break;
+        case pattern::letters:   p[i] = letters[rng() % (sizeof letters - 1)]; break;
+        }
+    }
+}
+
+// Same bytes with random case flips (through the locale) and, sometimes,
+// one byte changed.
+std::string case_variant(std::string_view s, std::mt19937& rng) {
+    std::string out(s);
+    for (char& c : out)
+        if (rng() % 2) c = rng() % 2 ? ref_upper(c) : ref_lower(c);
+    if (!out.empty() && rng() % 3 == 0) out[rng() % out.size()] ^= static_cast<char>(1 + rng() % 0x7f);
+    return out;
+}
+
+// A stateful allocator that hands out bytes from a caller's buffer and
+// never frees them; allocations past its end fail. Copies share the buffer.
+struct bump_buffer {
+    char* next;
+    char* end;
+};
+
+template <class T>
+struct buffer_allocator {
+    using value_type = T;
+
+    bump_buffer* buffer;
+
+    explicit buffer_allocator(bump_buffer& b) noexcept : buffer(&b) {}
+    template <class U>
+    buffer_allocator(const buffer_allocator<U>& o) noexcept : buffer(o.buffer) {}
+
+    T* allocate(std::size_t n) {
+        const std::size_t bytes = (n * sizeof(T) + alignof(std::max_align_t) - 1) &
+                                  ~(alignof(std::max_align_t) - 1);
+        if (bytes > static_cast<std::size_t>(buffer->end - buffer->next)) throw std::bad_alloc();
+        T* p = reinterpret_cast<T*>(buffer->next);
+        buffer->next += bytes;
+        return p;
+    }
+    void deallocate(T*, std::size_t) noexcept {}
+
+    template <class U>
+    bool operator==(const buffer_allocator<U>& o) const noexcept { return buffer == o.buffer; }
+    template <class U>
+    bool operator!=(const buffer_allocator<U>& o) const noexcept { return buffer != o.buffer; }
+};
+
+// An aligned scratch area with guard bytes on both sides.
+struct arena {
+    static constexpr std::size_t guard = 64;
+    alignas(64) char bytes[guard + max_align + max_len + guard];
+
+    char* at(std::size_t align) { return bytes + guard + align; }
+    void poison() { std::memset(bytes, 0x5a, sizeof bytes); }
+    bool guards_intact(std::size_t align, std::size_t n) const {
+        for (std::size_t i = 0; i < guard + align; ++i)
+            if (bytes[i] != 0x5a) return false;
+        for (std::size_t i = guard + align + n; i < sizeof bytes; ++i)
+            if (bytes[i] != 0x5a) return false;
+        return true;
+    }
+};
+
+// ------------------------------
+// Single bytes
+// ------------------------------
+void check_bytes(report& r) {
+    const cs::locale_snapshot loc;
+    for (int u = 0; u < 256; ++u) {
+        const char ch = static_cast<char>(u);
+        r.expect_byte(cs::to_upper(ch) == ref_upper(ch), "to_upper", u);
+        r.expect_byte(cs::to_lower(ch) == ref_lower(ch), "to_lower", u);
+        r.expect_byte(cs::ToUpper{}(ch) == ref_upper(ch), "ToUpper", u);
+        r.expect_byte(cs::ToLower{}(ch) == ref_lower(ch), "ToLower", u);
+        r.expect_byte(loc.to_upper(ch) == ref_upper(ch), "snapshot to_upper", u);
+        r.expect_byte(loc.to_lower(ch) == ref_lower(ch), "snapshot to_lower", u);
+        r.expect_byte(cs::ascii_to_upper(ch) == ref_ascii_upper(ch), "ascii_to_upper", u);
+        r.expect_byte(cs::ascii_to_lower(ch) == ref_ascii_lower(ch), "ascii_to_lower", u);
+        for (const class_ref& k : classes) {
+            const bool want = k.pred(u) != 0;
+            if (k.wrapper) r.expect_byte(k.wrapper(ch) == want, k.name, u);
+            r.expect_byte(cs::is_any(ch, k.cls) == want, "is_any", u);
+            r.expect_byte(cs::is_all(ch, k.cls) == want, "is_all", u);
+            r.expect_byte(loc.is(ch, k.cls) == want, "snapshot is", u);
+            r.expect_byte(cs::class_set(k.cls).contains(ch) == want, "class_set", u);
+        }
+        const char_class pair = char_class::digit | char_class::punct;
+        r.expect_byte(cs::is_any(ch, pair) == ref_is_any(ch, pair), "is_any(mask)", u);
+    }
+    // The fit decides which bytes the ASCII kernels may convert.
+    const cs::ascii_fit fit = loc.case_fit();
+    for (int u = 0; u < 256; ++u) {
+        const char ch = static_cast<char>(u);
+        const bool ascii_like = ref_upper(ch) == ref_ascii_upper(ch) && ref_lower(ch) == ref_ascii_lower(ch);
+        if (fit == cs::ascii_fit::all || (fit == cs::ascii_fit::low_half && u < 0x80))
+            r.expect_byte(ascii_like, "case_fit claims an ASCII mapping", u);
+    }
+}
+
+// Every byte through a basic_cctype front end against <cctype>, then its
+// bulk members against the policy's own per-byte mapping.
+template <class Policy>
+void check_policy(report& r, const cs::basic_cctype<Policy>& cc, const char* name, std::mt19937& rng) {
+    for (int u = 0; u < 256; ++u) {
+        const char ch = static_cast<char>(u);
+        r.expect_byte(cc.to_upper(ch) == ref_upper(ch), name, u);
+        r.expect_byte(cc.to_lower(ch) == ref_lower(ch), name, u);
+        for (const class_ref& k : classes)
+            r.expect_byte(cc.is_any(ch, k.cls) == (k.pred(u) != 0), name, u);
+    }
+
+    const auto lower = [&cc](char c) { return cc.to_lower(c); };
+    const auto folded_less = [&cc](char x, char y) {
+        return static_cast<unsigned char>(cc.to_lower(x)) < static_cast<unsigned char>(cc.to_lower(y));
+    };
+    const auto folded_equal = [&cc](char x, char y) { return cc.to_lower(x) == cc.to_lower(y); };
+    std::vector<char> bytes(max_len);
+    for (pattern kind : patterns) {
+        for (std::size_t n = 0; n <= max_len; n += 1 + n / 8) {
+            fill(bytes.data(), n, kind, rng);
+            const std::string in(bytes.data(), n);
+
+            std::string want = in;
+            for (char& c : want) c = cc.to_upper(c);
+            r.expect(cc.to_upper_copy(in) == want, "policy to_upper_copy", n);
+            std::string got = in;
+            cc.to_upper_inplace(got);
+            r.expect(got == want, "policy to_upper_inplace", n);
+            want = in;
+            for (char& c : want) c = cc.to_lower(c);
+            r.expect(cc.to_lower_copy(in) == want, "policy to_lower_copy", n);
+            std::list<char> chars(in.begin(), in.end());
+            cc.to_lower_inplace(chars.begin(), chars.end());
+            r.expect(std::equal(chars.begin(), chars.end(), want.begin(), want.end()),
+                     "policy to_lower_inplace (list)", n);
+
+            const class_ref& k = classes[rng() % std::size(classes)];
+            const auto in_class = [&cc, &k](char c) { return cc.is_any(c, k.cls); };
+            const auto scan = [&in, &in_class](bool first, bool member) {
+                for (std::size_t i = 0; i < in.size(); ++i) {
+                    const std::size_t at = first ? i : in.size() - 1 - i;
+                    if (in_class(in[at]) == member) return at;
+                }
+                return std::string_view::npos;
+            };
+            r.expect(cc.find_first_of_class(in, k.cls) == scan(true, true), "policy find_first_of_class", n);
+            r.expect(cc.find_first_not_of_class(in, k.cls) == scan(true, false), "policy find_first_not_of_class", n);
+            r.expect(cc.find_last_of_class(in, k.cls) == scan(false, true), "policy find_last_of_class", n);
+            r.expect(cc.find_last_not_of_class(in, k.cls) == scan(false, false), "policy find_last_not_of_class", n);
+            r.expect(cc.all_of_class(in, k.cls) == (scan(true, false) == std::string_view::npos),
+                     "policy all_of_class", n);
+            const std::size_t keep_from = std::min(scan(true, false), in.size());
+            const std::size_t keep_to = scan(false, false) == std::string_view::npos ? 0 : scan(false, false) + 1;
+            std::string trimmed = in;
+            cc.trim_inplace(trimmed, k.cls);
+            r.expect(trimmed == (keep_from < keep_to ? in.substr(keep_from, keep_to - keep_from) : std::string()),
+                     "policy trim_inplace", n);
+            trimmed = in;
+            cc.trim_left_inplace(trimmed, k.cls);
+            r.expect(trimmed == in.substr(keep_from), "policy trim_left_inplace", n);
+            trimmed = in;
+            cc.trim_right_inplace(trimmed, k.cls);
+            r.expect(trimmed == in.substr(0, keep_to), "policy trim_right_inplace", n);
+
+            // class_set overloads, with a set no char_class describes.
+            cs::class_set set;
+            for (int j = 0; j < 40; ++j) set.insert(static_cast<char>(rng()));
+            for (std::size_t i = 0; i < n; i += 3) set.insert(in[i]);
+            const auto set_first = [&in, &set](bool member) {
+                for (std::size_t i = 0; i < in.size(); ++i)
+                    if (set.contains(in[i]) == member) return i;
+                return std::string_view::npos;
+            };
+            const auto set_last = [&in, &set](bool member) {
+                for (std::size_t i = in.size(); i-- > 0;)
+                    if (set.contains(in[i]) == member) return i;
+                return std::string_view::npos;
+            };
+            r.expect(cc.find_first_of_class(in, set) == set_first(true) &&
+                         cc.find_first_not_of_class(in, set) == set_first(false) &&
+                         cc.find_last_of_class(in, set) == set_last(true) &&
+                         cc.find_last_not_of_class(in, set) == set_last(false),
+                     "policy find_*_of_class(class_set)", n);
+            r.expect(cc.all_of_class(in, set) == (set_first(false) == std::string_view::npos),
+                     "policy all_of_class(class_set)", n);
+            const std::size_t set_from = std::min(set_first(false), in.size());
+            const std::size_t set_to = set_last(false) == std::string_view::npos ? 0 : set_last(false) + 1;
+            const std::string set_kept = set_from < set_to ? in.substr(set_from, set_to - set_from) : std::string();
+            r.expect(cc.trim(in, set) == set_kept && cc.trim_left(in, set) == std::string_view(in).substr(set_from) &&
+                         cc.trim_right(in, set) == std::string_view(in).substr(0, set_to),
+                     "policy trim(class_set)", n);
+            trimmed = in;
+            cc.trim_inplace(trimmed, set);
+            std::string left = in;
+            cc.trim_left_inplace(left, set);
+            std::string right = in;
+            cc.trim_right_inplace(right, set);
+            r.expect(trimmed == set_kept && left == in.substr(set_from) && right == in.substr(0, set_to),
+                     "policy trim_*_inplace(class_set)", n);
+
+            const std::string variant = case_variant(in, rng);
+            const bool equal = std::equal(in.begin(), in.end(), variant.begin(), variant.end(), folded_equal);
+            r.expect(cc.iequals(in, variant) == equal, "policy iequals", n);
+            const bool less = std::lexicographical_compare(in.begin(), in.end(), variant.begin(), variant.end(),
+                                                           folded_less);
+            r.expect(cc.icompare(in, variant) == (equal ? 0 : less ? -1 : 1), "policy icompare", n);
+            if (equal) {
+                r.expect(cc.ihash(in) == cc.ihash(variant), "policy ihash of iequal inputs", n);
+                r.expect(cc.ci_hash_fn()(in) == cc.ci_hash_fn()(variant), "policy ci_hash", n);
+            }
+            r.expect(cc.ci_equal_fn()(in, variant) == equal, "policy ci_equal", n);
+            r.expect(cc.is_ascii(in) == std::all_of(in.begin(), in.end(), [](char c) {
+                         return static_cast<unsigned char>(c) < 0x80;
+                     }), "policy is_ascii", n);
+
+            for (std::size_t m : {std::size_t{0}, std::size_t{1}, std::size_t{5}, std::size_t{40}}) {
+                if (m > n) break;
+                const std::size_t at = rng() % (n - m + 1);
+                const std::string needle = case_variant(in.substr(at, m), rng);
+                const std::size_t fwd = ref_find(in, needle, false, lower);
+                const std::size_t rev = ref_find(in, needle, true, lower);
+                r.expect(cc.ifind(in, needle) == fwd, "policy ifind", n);
+                r.expect(cc.irfind(in, needle) == rev, "policy irfind", n);
+                r.expect(cc.icontains(in, needle) == (fwd != std::string_view::npos), "policy icontains", n);
+                r.expect(cc.istarts_with(in, needle) == (ref_find(in.substr(0, m), needle, false, lower) == 0),
+                         "policy istarts_with", n);
+                r.expect(cc.iends_with(in, needle) == (ref_find(in.substr(n - m), needle, false, lower) == 0),
+                         "policy iends_with", n);
+            }
+        }
+    }
+}
+
+// ------------------------------
+// Kernels
+// ------------------------------
+void check_kernels(report& r, const detail::kernel_table& k, std::mt19937& rng) {
+    const cs::locale_snapshot loc;
+    std::vector<cs::class_set> sets;
+    for (const class_ref& c : classes) sets.emplace_back(c.cls, loc);
+    for (int i = 0; i < 4; ++i) {
+        cs::class_set s;
+        for (int j = 0; j < 40; ++j) s.insert(static_cast<char>(rng()));
+        sets.push_back(s);
+    }
+
+    arena buf;
+    arena other;
+    for (pattern kind : patterns) {
+        for (std::size_t align = 0; align < max_align; ++align) {
+            for (std::size_t n = 0; n <= max_len; ++n) {
+                buf.poison();
+                char* p = buf.at(align);
+                fill(p, n, kind, rng);
+                const std::string in(p, n);
+
+                for (bool upper : {true, false}) {
+                    const auto convert = upper ? k.to_upper : k.to_lower;
+                    convert(p, p, n);
+                    bool ok = buf.guards_intact(align, n);
+                    for (std::size_t i = 0; i < n && ok; ++i)
+                        ok = p[i] == (upper ? ref_ascii_upper(in[i]) : ref_ascii_lower(in[i]));
+                    r.expect(ok, upper ? "kernel to_upper" : "kernel to_lower", n, align);
+                    std::memcpy(p, in.data(), n);
+
+                    // Copying form: source untouched, destination at another alignment.
+                    other.poison();
+                    const std::size_t dst_align = (align * 5 + 3) % max_align;
+                    char* q = other.at(dst_align);
+                    convert(p, q, n);
+                    ok = other.guards_intact(dst_align, n) && std::memcmp(p, in.data(), n) == 0;
+                    for (std::size_t i = 0; i < n && ok; ++i)
+                        ok = q[i] == (upper ? ref_ascii_upper(in[i]) : ref_ascii_lower(in[i]));
+                    r.expect(ok, upper ? "kernel to_upper (copy)" : "kernel to_lower (copy)", n, align);
+                }
+
+                std::size_t prefix = 0;
+                while (prefix < n && static_cast<unsigned char>(p[prefix]) < 0x80) ++prefix;
+                r.expect(k.ascii_prefix(p, n) == prefix, "kernel ascii_prefix", n, align);
+
+                const cs::class_set& set = sets[rng() % sets.size()];
+                for (bool member : {true, false}) {
+                    std::size_t first = n, last = n;
+                    for (std::size_t i = 0; i < n; ++i)
+                        if (set.contains(p[i]) == member) {
+                            if (first == n) first = i;
+                            last = i;
+                        }
+                    r.expect(k.find_first(p, n, set, member) == first, "kernel find_first", n, align);
+                    r.expect(k.find_last(p, n, set, member) == last, "kernel find_last", n, align);
+                }
+
+                other.poison();
+                char* q = other.at((align * 7) % max_align);
+                const std::string variant = case_variant(in, rng);
+                std::memcpy(q, variant.data(), n);
+                for (bool stop_at_high : {true, false}) {
+                    std::size_t want = n;
+                    for (std::size_t i = 0; i < n && want == n; ++i) {
+                        const bool high = ((static_cast<unsigned char>(p[i]) | static_cast<unsigned char>(q[i])) & 0x80) != 0;
+                        if (ref_ascii_lower(p[i]) != ref_ascii_lower(q[i]) || (stop_at_high && high)) want = i;
+                    }
+                    r.expect(k.ifold_mismatch(p, q, n, stop_at_high) == want, "kernel ifold_mismatch", n, align);
+                }
+
+                if (n >= 32) {
+                    unsigned char folded[32];
+                    const unsigned high = k.ascii_fold_block32(p, folded);
+                    bool ok = true, any_high = false;
+                    for (std::size_t i = 0; i < 32; ++i) {
+                        ok = ok && folded[i] == static_cast<unsigned char>(ref_ascii_lower(p[i]));
+                        any_high = any_high || (static_cast<unsigned char>(p[i]) & 0x80);
+                    }
+                    r.expect(ok && (high != 0) == any_high, "kernel ascii_fold_block32", n, align);
+                }
+
+                // Substring search is quadratic in the reference, so it runs
+                // on a subset of alignments.
+                if (n > 0 && align < 8) {
+                    for (std::size_t m : {std::size_t{1}, std::size_t{2}, std::size_t{3}, std::size_t{8},
+                                          std::size_t{17}, std::size_t{40}}) {
+                        if (m > n) break;
+                        // High bytes stay: under ascii_fit::all (e.g. C.UTF-8) any
+                        // needle reaches the kernels, which compare them unfolded.
+                        const std::string needle = case_variant(in.substr(rng() % (n - m + 1), m), rng);
+                        const std::string_view h(p, n);
+                        const std::size_t fwd = ref_find(h, needle, false, ref_ascii_lower);
+                        const std::size_t rev = ref_find(h, needle, true, ref_ascii_lower);
+                        r.expect(k.ifind_ascii(p, n, needle.data(), m) == (fwd == std::string_view::npos ? n : fwd),
+                                 "kernel ifind_ascii", n, align);
+                        r.expect(k.irfind_ascii(p, n, needle.data(), m) == (rev == std::string_view::npos ? n : rev),
+                                 "kernel irfind_ascii", n, align);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// ------------------------------
+// Public string API
+// ------------------------------
+// Same members as POSIX struct iovec, which is not available everywhere.
+struct iovec_like {
+    void* iov_base;
+    std::size_t iov_len;
+};
+
+// These iterators must reach the span kernels rather than the per-element
+// std::transform fallback.
+static_assert(cs::detail::is_contiguous_char_iterator<char*>);
+static_assert(cs::detail::is_contiguous_char_iterator<std::string::iterator>);
+static_assert(cs::detail::is_contiguous_char_iterator<std::vector<char>::iterator>);
+static_assert(cs::detail::is_contiguous_char_iterator<std::array<char, 16>::iterator>);
+static_assert(!cs::detail::is_contiguous_char_iterator<std::list<char>::iterator>);
+
+void check_api(report& r, std::mt19937& rng) {
+    const cs::locale_snapshot loc;
+    const char_class masks[] = {char_class::space, char_class::alpha | char_class::digit,
+                                char_class::punct, char_class::upper};
+    for (pattern kind : patterns) {
+        for (std::size_t n = 0; n <= max_len; ++n) {
+            std::string in(n, '\0');
+            fill(in.data(), n, kind, rng);
+
+            std::string upper_ref(in), lower_ref(in);
+            for (char& c : upper_ref) c = ref_upper(c);
+            for (char& c : lower_ref) c = ref_lower(c);
+
+            std::string s = in;
+            cs::to_upper_inplace(s);
+            r.expect(s == upper_ref, "to_upper_inplace", n);
+            s = in;
+            cs::to_lower_inplace(s);
+            r.expect(s == lower_ref, "to_lower_inplace", n);
+            s = in;
+            cs::to_upper_inplace(s, loc);
+            r.expect(s == upper_ref, "to_upper_inplace(snapshot)", n);
+            s = in;
+            cs::to_lower_inplace(s.begin(), s.end());
+            r.expect(s == lower_ref, "to_lower_inplace(iterators)", n);
+            std::vector<char> v(in.begin(), in.end());
+            cs::to_upper_inplace(v.begin(), v.end(), loc);
+            r.expect(std::string(v.begin(), v.end()) == upper_ref, "to_upper_inplace(iterators, snapshot)", n);
+            v.assign(in.begin(), in.end());
+            cs::to_lower_inplace(v.begin(), v.end());
+            r.expect(std::string(v.begin(), v.end()) == lower_ref, "to_lower_inplace(vector)", n);
+            std::array<char, max_len> a{};
+            std::copy(in.begin(), in.end(), a.begin());
+            cs::to_upper_inplace(a.begin(), a.begin() + n);
+            r.expect(std::string(a.begin(), a.begin() + n) == upper_ref, "to_upper_inplace(array)", n);
+            std::copy(in.begin(), in.end(), a.begin());
+            cs::to_lower_inplace(a.data(), a.data() + n, loc);
+            r.expect(std::string(a.data(), n) == lower_ref, "to_lower_inplace(pointers, snapshot)", n);
+            std::list<char> l(in.begin(), in.end());
+            cs::to_upper_inplace(l.begin(), l.end());
+            r.expect(std::string(l.begin(), l.end()) == upper_ref, "to_upper_inplace(list)", n);
+            r.expect(cs::to_upper_copy(in) == upper_ref, "to_upper_copy", n);
+            r.expect(cs::to_lower_copy(in, loc) == lower_ref, "to_lower_copy(snapshot)", n);
+            r.expect(cs::to_upper_copy(std::string(in)) == upper_ref, "to_upper_copy(string&&)", n);
+            r.expect(cs::to_lower_copy(std::string(in), loc) == lower_ref, "to_lower_copy(string&&, snapshot)", n);
+            {
+                // Each half of pool backs two results; a null upstream makes
+                // overflow throw rather than fall back to the heap.
+                alignas(std::max_align_t) static char pool[8 * (max_len + 64)];
+                constexpr std::size_t half = sizeof pool / 2;
+                const long allocations = global_allocations.load(std::memory_order_relaxed);
+#if defined(__cpp_lib_memory_resource)
+                std::pmr::monotonic_buffer_resource arena(pool, half, std::pmr::null_memory_resource());
+                const std::pmr::string pmr_upper = cs::to_upper_copy(in, &arena);
+                const std::pmr::string pmr_lower =
+                    cs::to_lower_copy(in, loc, std::pmr::polymorphic_allocator<char>(&arena));
+                r.expect(std::string_view(pmr_upper) == upper_ref && std::string_view(pmr_lower) == lower_ref,
+                         "to_upper_copy/to_lower_copy(pmr)", n);
+                r.expect(global_allocations.load(std::memory_order_relaxed) == allocations,
+                         "to_upper_copy/to_lower_copy(pmr) use only the resource", n);
+#endif
+                bump_buffer bump{pool + half, pool + sizeof pool};
+                const buffer_allocator<char> alloc(bump);
+                const auto alloc_upper = cs::to_upper_copy(in, loc, alloc);
+                const auto alloc_lower = cs::to_lower_copy(in, alloc);
+                r.expect(std::string_view(alloc_upper) == upper_ref && std::string_view(alloc_lower) == lower_ref,
+                         "to_upper_copy/to_lower_copy(allocator)", n);
+                r.expect(global_allocations.load(std::memory_order_relaxed) == allocations,
+                         "to_upper_copy/to_lower_copy(allocator) use only the allocator", n);
+            }
+            std::vector<std::string_view> pieces;
+            for (std::size_t pos = 0, len = 0; pos < n; pos += len) {
+                len = std::min<std::size_t>(n - pos, rng() % 48);
+                pieces.push_back(std::string_view(in).substr(pos, len));
+            }
+            cs::string_batch batch;
+            cs::to_upper_batch(pieces, batch, char_class::alnum);
+            bool batch_ok = batch.size() == pieces.size() && batch.bytes == upper_ref;
+            for (std::size_t i = 0; i < batch.size() && batch_ok; ++i)
+                batch_ok = batch.in_class[i] == std::all_of(batch[i].begin(), batch[i].end(), [](char c) {
+                               return ref_is_any(c, char_class::alnum);
+                           });
+            r.expect(batch_ok, "to_upper_batch", n);
+            cs::to_lower_batch(pieces, batch);
+            r.expect(batch.bytes == lower_ref && batch.in_class.empty(), "to_lower_batch", n);
+
+            // The same pieces as a string column over in.
+            std::vector<std::int64_t> offsets{0};
+            for (std::string_view piece : pieces) offsets.push_back(offsets.back() + static_cast<std::int64_t>(piece.size()));
+            const cs::large_string_column col{in.data(), offsets.data(), pieces.size()};
+            std::string column_out(n, '\0');
+            cs::to_upper_column(col, column_out.data());
+            r.expect(column_out == upper_ref, "to_upper_column", n);
+            std::vector<std::uint8_t> bits((pieces.size() + 7) / 8);
+            const auto bit = [&bits](std::size_t i) { return ((bits[i / 8] >> (i % 8)) & 1) != 0; };
+            cs::all_of_class_column(col, char_class::alnum, bits.data());
+            bool column_ok = true;
+            for (std::size_t i = 0; i < pieces.size(); ++i)
+                column_ok &= bit(i) == std::all_of(pieces[i].begin(), pieces[i].end(),
+                                                   [](char c) { return ref_is_any(c, char_class::alnum); });
+            r.expect(column_ok, "all_of_class_column", n);
+            // Bits past the last row are padding and must be left clear.
+            const auto padding_clear = [&bits, rows = pieces.size()] {
+                return rows % 8 == 0 || (bits[rows / 8] >> (rows % 8)) == 0;
+            };
+            r.expect(padding_clear(), "all_of_class_column padding bits", n);
+            const std::string_view column_needle = pieces.empty() ? std::string_view() : pieces[rng() % pieces.size()];
+            cs::iequals_column(col, column_needle, bits.data());
+            column_ok = true;
+            for (std::size_t i = 0; i < pieces.size(); ++i)
+                column_ok &= bit(i) == (pieces[i].size() == column_needle.size() &&
+                                        std::equal(pieces[i].begin(), pieces[i].end(), column_needle.begin(),
+                                                   [](char x, char y) { return ref_lower(x) == ref_lower(y); }));
+            r.expect(column_ok && padding_clear(), "iequals_column", n);
+            std::string trimmed;
+            std::vector<std::int64_t> trimmed_offsets;
+            cs::trim_column(col, trimmed, trimmed_offsets);
+            column_ok = trimmed_offsets.size() == pieces.size() + 1 &&
+                        trimmed.size() == static_cast<std::size_t>(trimmed_offsets.back());
+            for (std::size_t i = 0; i < pieces.size() && column_ok; ++i) {
+                std::string_view want = pieces[i];
+                while (!want.empty() && ref_is_any(want.front(), char_class::space)) want.remove_prefix(1);
+                while (!want.empty() && ref_is_any(want.back(), char_class::space)) want.remove_suffix(1);
+                column_ok = std::string_view(trimmed).substr(static_cast<std::size_t>(trimmed_offsets[i]),
+                                                             static_cast<std::size_t>(trimmed_offsets[i + 1] - trimmed_offsets[i])) == want;
+            }
+            r.expect(column_ok, "trim_column", n);
+            // The same pieces as a scatter-gather chain.
+            std::string chained = in;
+            std::vector<iovec_like> chain;
+            for (std::string_view piece : pieces)
+                chain.push_back({chained.data() + (piece.data() - in.data()), piece.size()});
+            const std::string_view chain_needle = n == 0 ? std::string_view("x") : std::string_view(upper_ref).substr(rng() % n, 1 + rng() % 6);
+            const std::size_t chain_pos = rng() % (n + 1);
+            r.expect(cs::ifind(chain.data(), chain.size(), chain_needle, chain_pos) == cs::ifind(in, chain_needle, chain_pos),
+                     "ifind(iovec)", n);
+            r.expect(cs::find_first_not_of_class(chain.data(), chain.size(), char_class::alpha, chain_pos) ==
+                             cs::find_first_not_of_class(in, char_class::alpha, chain_pos) &&
+                         cs::find_last_of_class(chain.data(), chain.size(), char_class::space, chain_pos) ==
+                             cs::find_last_of_class(in, char_class::space, chain_pos),
+                     "find_*_of_class(iovec)", n);
+            cs::to_upper_inplace(chain.data(), chain.size());
+            r.expect(chained == upper_ref, "to_upper_inplace(iovec)", n);
+
+            std::string into = "prefix";
+            cs::to_upper_into(in, into);
+            cs::to_lower_into(in, into, loc);
+            r.expect(into == "prefix" + upper_ref + lower_ref, "to_upper_into/to_lower_into(string)", n);
+#if defined(__cpp_lib_span)
+            std::vector<char> span_buf(n + 1, '#');
+            const auto written = cs::to_upper_into(in, std::span<char>(span_buf));
+            r.expect(written.data() == span_buf.data() && std::string_view(written.data(), written.size()) == upper_ref &&
+                         span_buf[n] == '#', "to_upper_into(span)", n);
+            const auto cut = cs::to_lower_into(in, std::span<char>(span_buf).first(n / 2), loc);
+            r.expect(std::string_view(cut.data(), cut.size()) == std::string_view(lower_ref).substr(0, n / 2),
+                     "to_lower_into(span, snapshot), truncated", n);
+#endif
+#if defined(__cpp_lib_ranges)
+            const auto upper_view = std::string_view(in) | cs::views::upper;
+            r.expect(std::ranges::equal(upper_view, upper_ref), "views::upper", n);
+            r.expect(std::ranges::equal(upper_view | std::views::reverse, upper_ref | std::views::reverse),
+                     "views::upper | reverse", n);
+            if (n != 0) {
+                const std::size_t at = rng() % n;
+                r.expect(upper_view[at] == upper_ref[at] && upper_view.size() == n, "views::upper[i]", n);
+                // A jump leaves the window behind; the steps after it must refill.
+                auto it = upper_view.begin() + static_cast<std::ptrdiff_t>(at);
+                std::string walked;
+                for (std::size_t i = 0; i < 70 && it != upper_view.end(); ++i, ++it) walked += *it;
+                auto back = upper_view.end() - static_cast<std::ptrdiff_t>(n - at);
+                for (std::size_t i = 0; i < 70 && back != upper_view.begin(); ++i) walked += *--back;
+                std::string expected = upper_ref.substr(at, 70);
+                for (std::size_t i = 0; i < 70 && i < at; ++i) expected += upper_ref[at - 1 - i];
+                r.expect(walked == expected, "views::upper jump then step", n);
+            }
+            r.expect(std::string(in | cs::views::lower) == lower_ref, "std::string(views::lower)", n);
+            std::string view_out(n, '#');
+            std::ranges::copy(in | cs::views::lower, view_out.begin());
+            r.expect(view_out == lower_ref, "ranges::copy(views::lower)", n);
+            r.expect(std::ranges::equal(in | (cs::views::upper | std::views::take(3)),
+                                        std::string_view(upper_ref).substr(0, 3)),
+                     "views::upper | take (closure)", n);
+            r.expect(std::ranges::equal(in | (std::views::drop(1) | cs::views::lower),
+                                        std::string_view(lower_ref).substr(n == 0 ? 0 : 1)),
+                     "drop | views::lower (closure)", n);
+            const std::list<char> view_list(in.begin(), in.end());
+            r.expect(std::ranges::equal(view_list | cs::views::upper, upper_ref), "views::upper (list)", n);
+            std::string alpha_ref;
+            std::copy_if(in.begin(), in.end(), std::back_inserter(alpha_ref),
+                         [](char c) { return ref_is_any(c, char_class::alpha); });
+            r.expect(std::ranges::equal(in | cs::views::filter_class(char_class::alpha), alpha_ref),
+                     "views::filter_class", n);
+            r.expect(std::ranges::equal(in | (cs::views::filter_class(char_class::alpha) | cs::views::lower),
+                                        alpha_ref | std::views::transform(ref_lower)),
+                     "filter_class | views::lower (closure)", n);
+#endif
+            cs::case_stats stats;
+            s = in;
+            cs::to_upper_inplace(s, stats);
+            r.expect(s == upper_ref && stats.ascii_bytes + stats.locale_bytes == n,
+                     "to_upper_inplace(case_stats)", n);
+            r.expect(cs::is_ascii(in) == std::all_of(in.begin(), in.end(), [](char c) {
+                         return static_cast<unsigned char>(c) < 0x80;
+                     }), "is_ascii", n);
+
+            for (char_class mask : masks) {
+                std::size_t first = std::string_view::npos, first_not = first, last = first, last_not = first;
+                for (std::size_t i = 0; i < n; ++i) {
+                    const bool in_mask = ref_is_any(in[i], mask);
+                    if (in_mask && first == std::string_view::npos) first = i;
+                    if (!in_mask && first_not == std::string_view::npos) first_not = i;
+                    if (in_mask) last = i;
+                    if (!in_mask) last_not = i;
+                }
+                r.expect(cs::find_first_of_class(in, mask) == first, "find_first_of_class", n);
+                r.expect(cs::find_first_not_of_class(in, mask) == first_not, "find_first_not_of_class", n);
+                r.expect(cs::find_last_of_class(in, mask) == last, "find_last_of_class", n);
+                r.expect(cs::find_last_not_of_class(in, mask) == last_not, "find_last_not_of_class", n);
+                const std::string_view t = cs::trim(in, mask);
+                const std::size_t b = first_not == std::string_view::npos ? n : first_not;
+                const std::size_t e = last_not == std::string_view::npos ? b : last_not + 1;
+                r.expect(t.data() == in.data() + b && t.size() == e - b, "trim", n);
+            }
+
+            const std::string variant = case_variant(in, rng);
+            int want = 0;
+            for (std::size_t i = 0; i < n && want == 0; ++i) {
+                const auto x = static_cast<unsigned char>(ref_lower(in[i]));
+                const auto y = static_cast<unsigned char>(ref_lower(variant[i]));
+                if (x != y) want = x < y ? -1 : 1;
+            }
+            r.expect(cs::iequals(in, variant) == (want == 0), "iequals", n);
+            r.expect(cs::icompare(in, variant) == want, "icompare", n);
+            if (want == 0) r.expect(cs::ihash(in) == cs::ihash(variant), "ihash of iequal inputs", n);
+
+            for (std::size_t m : {std::size_t{1}, std::size_t{4}, std::size_t{33}}) {
+                if (m > n) break;
+                const std::string needle = case_variant(in.substr(rng() % (n - m + 1), m), rng);
+                r.expect(cs::ifind(in, needle) == ref_find(in, needle, false, ref_lower), "ifind", n);
+                r.expect(cs::irfind(in, needle) == ref_find(in, needle, true, ref_lower), "irfind", n);
+            }
+        }
+    }
+}
+
+// ------------------------------
+// Concurrent locale flips
+// ------------------------------
+// flip_threads readers run the runtime API while one thread alternates
+// between "C" and other through set_locale / refresh_locale. Every result
+// must equal what the tables of one of the two locales give; a call that
+// mixed tables, or read freed ones, fails. Built with -fsanitize=thread
+// this doubles as the race check for the publication path.
+constexpr int flip_threads = 32;
+constexpr int flip_rounds = 40;
+
+// One reader's tally. want(cc) gives the expected value through one table
+// set; both candidates come from snapshots, so the check itself never
+// reads the published tables.
+struct flip_report {
+    const cs::snapshot_cctype* tables;
+    long checks = 0;
+    long failures = 0;
+    const char* first = nullptr;
+
+    template <class Got, class Want>
+    void expect(const Got& got, const Want& want, const char* what) {
+        ++checks;
+        if (got == want(tables[0]) || got == want(tables[1])) return;
+        if (failures++ == 0) first = what;
+    }
+};
+
+void check_locale_flips(report& r, const std::string& other) {
+    cs::set_locale(LC_ALL, "C");
+    const cs::locale_snapshot& c_tables = cs::refresh_locale();
+    cs::set_locale(LC_ALL, other.c_str());
+    const cs::locale_snapshot& other_tables = cs::refresh_locale();
+    const cs::snapshot_cctype tables[2] = {cs::snapshot_cctype{cs::policy::snapshot(c_tables)},
+                                           cs::snapshot_cctype{cs::policy::snapshot(other_tables)}};
+
+    // Inputs are built up front: readers must not call <cctype> while
+    // the flipper changes the global locale under it.
+    std::mt19937 rng(777);
+    std::vector<std::string> inputs, variants;
+    for (std::size_t n : {std::size_t{0}, std::size_t{7}, std::size_t{16}, std::size_t{40}, std::size_t{300}}) {
+        for (pattern kind : patterns) {
+            std::string in(n, '\0');
+            fill(in.data(), n, kind, rng);
+            variants.push_back(case_variant(in, rng));
+            inputs.push_back(std::move(in));
+        }
+    }
+
+    std::atomic<int> running{flip_threads};
+    std::vector<flip_report> results(flip_threads, flip_report{tables});
+    std::vector<std::thread> readers;
+    for (int t = 0; t < flip_threads; ++t) {
+        readers.emplace_back([&, t] {
+            flip_report& fr = results[t];
+            for (int round = 0; round < flip_rounds; ++round) {
+                for (int u = 0; u < 256; ++u) {
+                    const char ch = static_cast<char>(u);
+                    fr.expect(cs::to_upper(ch), [ch](const auto& cc) { return cc.to_upper(ch); }, "to_upper");
+                    fr.expect(cs::to_lower(ch), [ch](const auto& cc) { return cc.to_lower(ch); }, "to_lower");
+                    fr.expect(cs::is_alpha(ch), [ch](const auto& cc) { return cc.is_alpha(ch); }, "is_alpha");
+                    fr.expect(cs::is_punct(ch), [ch](const auto& cc) { return cc.is_punct(ch); }, "is_punct");
+                    fr.expect(cs::is_any(ch, char_class::upper | char_class::digit),
+                              [ch](const auto& cc) { return cc.is_any(ch, char_class::upper | char_class::digit); },
+                              "is_any");
+                }
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                    const std::string& in = inputs[i];
+                    const std::string& variant = variants[i];
+                    const std::string needle = in.substr(in.size() / 3, std::min<std::size_t>(in.size() / 3, 5));
+                    fr.expect(cs::to_upper_copy(in), [&](const auto& cc) { return cc.to_upper_copy(in); },
+                              "to_upper_copy");
+                    std::string lowered = in;
+                    cs::to_lower_inplace(lowered);
+                    fr.expect(lowered, [&](const auto& cc) { return cc.to_lower_copy(in); }, "to_lower_inplace");
+                    fr.expect(cs::find_first_of_class(in, char_class::alpha),
+                              [&](const auto& cc) { return cc.find_first_of_class(in, char_class::alpha); },
+                              "find_first_of_class");
+                    fr.expect(cs::find_last_not_of_class(in, char_class::lower),
+                              [&](const auto& cc) { return cc.find_last_not_of_class(in, char_class::lower); },
+                              "find_last_not_of_class");
+                    fr.expect(cs::trim(in, char_class::alpha),
+                              [&](const auto& cc) { return cc.trim(in, char_class::alpha); }, "trim");
+                    fr.expect(cs::iequals(in, variant), [&](const auto& cc) { return cc.iequals(in, variant); },
+                              "iequals");
+                    fr.expect(cs::icompare(in, variant), [&](const auto& cc) { return cc.icompare(in, variant); },
+                              "icompare");
+                    fr.expect(cs::ifind(variant, needle), [&](const auto& cc) { return cc.ifind(variant, needle); },
+                              "ifind");
+                    fr.expect(cs::ihash(in), [&](const auto& cc) { return cc.ihash(in); }, "ihash");
+                }
+            }
+            running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    std::thread flipper([&] {
+        for (long i = 0; running.load(std::memory_order_acquire) != 0; ++i) {
+            if (i % 2 == 0)
+                cs::set_locale(LC_ALL, i % 4 == 0 ? "C" : other.c_str());
+            else
+                cs::refresh_locale();
+        }
+    });
+    for (std::thread& t : readers) t.join();
+    flipper.join();
+
+    for (const flip_report& fr : results) {
+        r.checks += fr.checks;
+        if (fr.failures != 0) r.fail("%s under concurrent locale flips (%ld times)", fr.first, fr.failures);
+    }
+}
+
+std::vector<std::string> installed_locales() {
+    std::vector<std::string> out;
+#if defined(__unix__) || defined(__APPLE__)
+    if (std::FILE* f = popen("locale -a 2>/dev/null", "r")) {
+        char line[256];
+        while (std::fgets(line, sizeof line, f)) {
+            std::string name(line);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r')) name.pop_back();
+            if (!name.empty()) out.push_back(name);
+        }
+        pclose(f);
+    }
+#endif
+    if (out.empty()) out.emplace_back("C");
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> locales(argv + 1, argv + argc);
+    if (locales.empty()) locales = installed_locales();
+
+    std::vector<cs::kernel_isa> isas;
+    for (cs::kernel_isa isa : {cs::kernel_isa::scalar, cs::kernel_isa::sse2, cs::kernel_isa::avx2,
+                               cs::kernel_isa::avx512bw})
+        if (detail::cpu_supports(isa)) isas.push_back(isa);
+
+    long failures = 0;
+    std::string flip_partner;  // first locale whose case mapping is not ASCII
+    for (const std::string& name : locales) {
+        if (std::setlocale(LC_ALL, name.c_str()) == nullptr) {
+            std::printf("skip [%s] not installed\n", name.c_str());
+            continue;
+        }
+        // Start from the <cctype> path: drop tables a previous locale published.
+        detail::published_snapshot.store(nullptr, std::memory_order_release);
+        report r{name};
+        std::mt19937 rng(12345);
+        check_bytes(r);
+        const cs::locale_snapshot loc;
+        if (flip_partner.empty() && loc.case_fit() != cs::ascii_fit::all) flip_partner = name;
+        check_policy(r, cs::snapshot_cctype{cs::policy::snapshot(loc)}, "policy::snapshot", rng);
+        check_policy(r, cs::cctype{}, "policy::runtime_locale", rng);
+        if (name == "C" || name == "POSIX") {
+            check_policy(r, cs::ascii_cctype{}, "policy::ascii", rng);
+            check_policy(r, cs::c_locale_cctype{}, "policy::c_locale_constexpr", rng);
+        }
+        for (cs::kernel_isa isa : isas) check_kernels(r, detail::make_kernel_table(isa), rng);
+        check_api(r, rng);
+        cs::refresh_locale();
+        check_bytes(r);
+        check_api(r, rng);
+        std::printf("%s [%s] %ld checks, %ld failures\n", r.failures ? "FAIL" : "ok", name.c_str(),
+                    r.checks, r.failures);
+        failures += r.failures;
+    }
+    if (!flip_partner.empty()) {
+        report r{"C <-> " + flip_partner};
+        check_locale_flips(r, flip_partner);
+        std::printf("%s [%s] %ld checks under concurrent flips, %ld failures\n", r.failures ? "FAIL" : "ok",
+                    r.locale.c_str(), r.checks, r.failures);
+        failures += r.failures;
+    } else {
+        std::printf("skip concurrent locale flips: no locale with a non-ASCII case mapping\n");
+    }
+    std::printf("kernels checked:");
+    for (cs::kernel_isa isa : isas) std::printf(" %s", std::string(cs::kernel_name(isa)).c_str());
+    std::printf("\n");
+    return failures == 0 ? 0 : 1;
+}